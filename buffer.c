@@ -2,7 +2,6 @@
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/uio.h>
-#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <errno.h>
@@ -23,6 +22,7 @@
 #include "evthread.h"
 #include "evbuffer.h"
 #include "bufferevent_internal.h"
+#include "event_internal.h"
 
 static int use_sendfile  = 1;
 static int use_mmap = 1;
@@ -200,14 +200,24 @@ static struct evbuffer_chain *evbuffer_chain_insert_new(struct evbuffer *buf, si
 }
 
 struct evbuffer* evbuffer_new(){
+    return evbuffer_new_pooled_(NULL);
+}
+
+struct evbuffer *evbuffer_new_pooled_(struct event_base *base)
+{
     struct evbuffer *buffer;
-    buffer = (struct evbuffer*)mm_calloc(1,sizeof(struct evbuffer));
+
+    if (!event_base_pool_enabled_(base))
+        base = NULL;
+    buffer = (struct evbuffer*)event_base_pool_get_(base, EVENT_POOL_EVBUFFER, sizeof(struct evbuffer));
     if(buffer == NULL)
         return NULL;
+    memset(buffer, 0, sizeof(struct evbuffer));
 
     TAILQ_INIT(&buffer->callbacks);
     buffer->refcnt = 1;
     buffer->last_with_datap = &buffer->first;
+    buffer->pool_base = base;
 
     return buffer;
 }
@@ -388,7 +398,7 @@ void evbuffer_decref_and_unlock(struct evbuffer *buffer)
     EVBUFFER_UNLOCK(buffer);
     if (buffer->own_lock)
         EVTHREAD_FREE_LOCK(buffer->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
-    mm_free(buffer);
+    event_base_pool_put_(buffer->pool_base, EVENT_POOL_EVBUFFER, buffer, sizeof(struct evbuffer));
 }
 
 void evbuffer_free(struct evbuffer *buffer)
@@ -1796,15 +1806,12 @@ int evbuffer_cb_clear_flags(struct evbuffer *buffer, struct evbuffer_cb_entry *c
     return 0;
 }
 
-#define EVBUFFER_MAX_READ	4096
-
-static int get_n_bytes_readable_on_socket(int fd)
-{
-    int n = EVBUFFER_MAX_READ;
-    if (ioctl(fd, FIONREAD, &n) < 0)
-        return -1;
-    return n;
-}
+/*
+ * 一次读取的字节数：不用ioctl(FIONREAD)查询可读字节数（每次读取多一次系统调用），由调用者决定读多少，
+ * bufferevent按连接自适应调整；howmuch为负数时读EVBUFFER_READ_DEFAULT字节
+ */
+#define EVBUFFER_READ_DEFAULT	4096
+#define EVBUFFER_MAX_READ	(1024 * 1024)
 
 static inline int evbuffer_write_sendfile(struct evbuffer *buffer, int fd, ssize_t howmuch)
 {
@@ -1856,7 +1863,7 @@ static inline int evbuffer_write_iovec(struct evbuffer *buffer, int fd, ssize_t
     return (n);
 }
 
-#define NUM_READ_IOVEC 4
+#define NUM_READ_IOVEC 16
 int evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
 {
     struct evbuffer_chain **chainp;
@@ -1871,11 +1878,10 @@ int evbuffer_read(struct evbuffer *buf, int fd, int howmuch)
         goto done;
     }
 
-    n = get_n_bytes_readable_on_socket(fd);
-    if (n <= 0 || n > EVBUFFER_MAX_READ)
-        n = EVBUFFER_MAX_READ;
-    if (howmuch < 0 || howmuch > n)
-        howmuch = n;
+    if (howmuch < 0)
+        howmuch = EVBUFFER_READ_DEFAULT;
+    else if (howmuch > EVBUFFER_MAX_READ)
+        howmuch = EVBUFFER_MAX_READ;
 
     /* 预留空间 */
 	if (evbuffer_expand_fast(buf, howmuch, NUM_READ_IOVEC) == -1) {
@@ -15,6 +15,7 @@
 #include "bufferevent_internal.h"
 #include "evbuffer.h"
 #include "evutil.h"
+#include "event_internal.h"
 
 static void bufferevent_cancel_all(struct bufferevent *bev);
 
@@ -135,8 +136,11 @@ int bufferevent_decref_and_unlock(struct bufferevent *bufev)
     if (bufev_private->own_lock)
         EVTHREAD_FREE_LOCK(bufev_private->lock, EVTHREAD_LOCKTYPE_RECURSIVE);
 
-    /* 释放内存. */
-    mm_free(((char*)bufev) - bufev->be_ops->mem_offset);
+    /* 释放内存，socket类型的bufferevent从event_base的对象池中分配 */
+    if (bufev->be_ops == &bufferevent_ops_socket)
+        event_base_pool_put_(bufev->ev_base, EVENT_POOL_BUFFEREVENT, bufev_private, sizeof(struct bufferevent_private));
+    else
+        mm_free(((char*)bufev) - bufev->be_ops->mem_offset);
 
     /* 释放底层引用计数*/
     if (underlying)
@@ -175,13 +179,13 @@ int bufferevent_init_common(struct bufferevent_private *bufev_private, struct ev
 
     //分配输入缓冲区
     if (!bufev->input) {
-        if ((bufev->input = evbuffer_new()) == NULL)
+        if ((bufev->input = evbuffer_new_pooled_(base)) == NULL)
             return -1;
     }
 
     //分配输出缓冲区
     if (!bufev->output) {
-        if ((bufev->output = evbuffer_new()) == NULL) {
+        if ((bufev->output = evbuffer_new_pooled_(base)) == NULL) {
             evbuffer_free(bufev->input);
             return -1;
         }
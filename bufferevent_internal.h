@@ -30,6 +30,12 @@ struct bufferevent_private {
     /** 标志连接被拒绝  */
     unsigned connection_refused : 1;
 
+    /** 输出缓冲区已经写完，ev_write仍然注册着（去掉了超时），等待下一次写入或者空闲唤醒次数用完 */
+    unsigned write_lingering : 1;
+
+    /** BEV_OPT_EDGE_TRIGGERED并且后端支持边缘触发，读写事件使用EV_ET */
+    unsigned edge_triggered : 1;
+
     /*如果我们延迟回调并且事件回调待处理，设置为待处理的事件*/
     short eventcb_pending;
 
@@ -45,9 +51,24 @@ struct bufferevent_private {
     /** 用于bufferevent_socket_connect_hostname的DNS错误码 */
     int dns_error;
 
+    /** 输出缓冲区写完后ev_write最多保持注册的空闲唤醒次数，0表示写完立即删除 */
+    int write_linger;
+    /** write_lingering时已经发生的空闲可写唤醒次数 */
+    int write_idle_wakeups;
+
+    /** 下一次从套接字读取的字节数，在[read_size_min, read_size_max]中根据每次实际读到的字节数自适应调整 */
+    int read_size;
+    int read_size_min;
+    int read_size_max;
+    /** 上一次读取的字节数不到read_size的一半，再有一次就缩小read_size */
+    unsigned read_shrink_pending : 1;
+
     /** 延迟回调函数 */
     struct deferred_cb deferred;
 
+    /** BEV_OPT_EAGER_WRITE：当前这批回调结束后直接写套接字的延迟回调 */
+    struct deferred_cb deferred_write;
+
     /** bufferevent的构造选项 */
     enum bufferevent_options options;
 
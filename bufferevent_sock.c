@@ -16,6 +16,7 @@
 #include "evmemory.h"
 #include "bufferevent_internal.h"
 #include "evutil.h"
+#include "event_internal.h"
 
 static int be_socket_enable(struct bufferevent *, short);
 static int be_socket_disable(struct bufferevent *, short);
@@ -36,8 +37,54 @@ const struct bufferevent_ops bufferevent_ops_socket = {
         be_socket_ctrl,
 };
 
+//BEV_OPT_EDGE_TRIGGERED：一次唤醒最多读/写这么多字节，用完后重新激活事件，让同一轮中其它激活的事件也能得到处理
+#define BEV_EDGE_TRIGGERED_BUDGET (256 * 1024)
+
+//每次从套接字读取的字节数的默认范围和初始值
+#define BEV_READ_SIZE_MIN 512
+#define BEV_READ_SIZE_MAX 65536
+#define BEV_READ_SIZE_INITIAL 4096
+//bufferevent_socket_set_read_size允许的最大值，和evbuffer_read一次最多读取的字节数一致
+#define BEV_READ_SIZE_LIMIT (1024 * 1024)
+
+//根据这次读到的字节数调整下一次读取的大小：读满时扩大4倍，连续两次不到一半时缩小一半
+static inline void bufferevent_socket_adjust_read_size(struct bufferevent_private *bufev_p, int n)
+{
+    if (n >= bufev_p->read_size) {
+        bufev_p->read_size = bufev_p->read_size > bufev_p->read_size_max / 4 ?
+                bufev_p->read_size_max : bufev_p->read_size * 4;
+        bufev_p->read_shrink_pending = 0;
+    }
+    else if (n <= bufev_p->read_size / 2) {
+        if (bufev_p->read_shrink_pending) {
+            bufev_p->read_size = bufev_p->read_size / 2 < bufev_p->read_size_min ?
+                    bufev_p->read_size_min : bufev_p->read_size / 2;
+            bufev_p->read_shrink_pending = 0;
+        }
+        else {
+            bufev_p->read_shrink_pending = 1;
+        }
+    }
+    else {
+        bufev_p->read_shrink_pending = 0;
+    }
+}
+
+//读写事件需要的EV_ET标志
+#define bufferevent_socket_et(bufev) \
+    (EVUTIL_UPCAST((bufev), struct bufferevent_private, bev)->edge_triggered ? EV_ET : 0)
+
+//边缘触发时没有遇到EAGAIN就停止读写，内核不会再通知，需要手动激活事件
+static inline void bufferevent_socket_rearm(struct bufferevent *bufev, struct event *ev, short what)
+{
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
+    if (bufev_p->edge_triggered)
+        event_active(ev, what, 1);
+}
+
 /*
  当socket有数据可读时，Libevent就会监听到，然后调用bufferevent_readcb函数处理。该函数会调用evbuffer_read函数，把数据从socket fd中读取到evbuffer中。然后再调用用户在bufferevent_setcb函数中设置的读事件回调函数。所以，当用户的读事件回调函数被调用时，数据已经在evbuffer中了，用户拿来就用，无需调用read这类会阻塞的函数。
+ BEV_OPT_EDGE_TRIGGERED时循环读到EAGAIN，最多读BEV_EDGE_TRIGGERED_BUDGET字节，然后只调用一次用户的读回调
 */
 static void bufferevent_readcb(int fd, short event, void *arg)
 {
@@ -46,7 +93,8 @@ static void bufferevent_readcb(int fd, short event, void *arg)
     struct evbuffer *input;
     int res = 0;
     short what = BEV_EVENT_READING;
-    ssize_t howmuch = -1, readmax=-1;
+    ssize_t howmuch = -1, readmax=-1, total = 0;
+    ssize_t budget = (bufev_p->options & BEV_OPT_EDGE_TRIGGERED) ? BEV_EDGE_TRIGGERED_BUDGET : 0;
 
     bufferevent_incref_and_lock(bufev);
 
@@ -58,46 +106,61 @@ static void bufferevent_readcb(int fd, short event, void *arg)
 
     input = bufev->input;
 
-    /* 如果我们配置了一个高水位，那么我们需要判断读取的数据是否会超过高水位.*/
-    if (bufev->wm_read.high != 0) {
-        howmuch = bufev->wm_read.high - evbuffer_get_length(input);//当前缓冲区中距离高水位的字节数，小于等于0，停止读
-        if (howmuch <= 0) {
-            bufferevent_suspend_read(bufev,BEV_SUSPEND_WM);
-            goto done;
+    for (;;) {
+        howmuch = -1;
+        /* 如果我们配置了一个高水位，那么我们需要判断读取的数据是否会超过高水位.*/
+        if (bufev->wm_read.high != 0) {
+            howmuch = bufev->wm_read.high - evbuffer_get_length(input);//当前缓冲区中距离高水位的字节数，小于等于0，停止读
+            if (howmuch <= 0) {
+                bufferevent_suspend_read(bufev,BEV_SUSPEND_WM);
+                break;
+            }
         }
-    }
 
-    //用户最大可读字节，16384字节，即16K。
-    readmax = 16384;
-    if (howmuch < 0 || howmuch > readmax) /* 使用-1来代替"unlimited"*/
-        howmuch = readmax;
-    if (bufev_p->read_suspended)
-        goto done;
+        //这次读取的字节数，按连接自适应调整
+        readmax = bufev_p->read_size;
+        if (howmuch < 0 || howmuch > readmax) /* 使用-1来代替"unlimited"*/
+            howmuch = readmax;
+        if (bufev_p->read_suspended)
+            break;
 
-    evbuffer_unfreeze(input, 0);//解冻，使得可以在input的后面追加数据
-    res = evbuffer_read(input, fd, (int)howmuch);//从fd读取数据
-    evbuffer_freeze(input, 0);
+        evbuffer_unfreeze(input, 0);//解冻，使得可以在input的后面追加数据
+        res = evbuffer_read(input, fd, (int)howmuch);//从fd读取数据
+        evbuffer_freeze(input, 0);
 
-    if (res == -1) {//发送错误，不是 EINTER/EAGAIN 这两个可以重试的错误，此时，应该报告给用户
-        int err = errno;
-        if (EVUTIL_ERR_RW_RETRIABLE(err))
-            goto reschedule;
-        what |= BEV_EVENT_ERROR;
-    }
-    else if (res == 0) {//断开了连接
-        what |= BEV_EVENT_EOF;
+        if (res == -1) {//发送错误，不是 EINTER/EAGAIN 这两个可以重试的错误，此时，应该报告给用户
+            int err = errno;
+            if (EVUTIL_ERR_RW_RETRIABLE(err))
+                break;
+            what |= BEV_EVENT_ERROR;
+        }
+        else if (res == 0) {//断开了连接
+            what |= BEV_EVENT_EOF;
+        }
+        if (res <= 0)
+            break;
+
+        //被高水位限制的读取不能说明读取大小是否合适
+        if (howmuch == readmax)
+            bufferevent_socket_adjust_read_size(bufev_p, res);
+
+        total += res;
+        if (!budget)
+            break;
+        //预算用完，套接字中可能还有数据
+        if (total >= budget) {
+            bufferevent_socket_rearm(bufev, &bufev->ev_read, EV_READ);
+            break;
+        }
     }
 
-    if (res <= 0)
-        goto error;
-
     /* //evbuffer的数据量大于低水位值,调用用户设置的读回调 */
-    if (evbuffer_get_length(input) >= bufev->wm_read.low)
+    if (total > 0 && evbuffer_get_length(input) >= bufev->wm_read.low)
         bufferevent_run_readcb(bufev);
 
-    goto done;
+    if (what != BEV_EVENT_READING)
+        goto error;
 
-reschedule:
     goto done;
 
 error:
@@ -108,6 +171,28 @@ done:
     bufferevent_decref_and_unlock(bufev);//减少引用计数并解锁
 }
 
+//输出缓冲区写完：设置了write_linger或者边缘触发时保留ev_write的注册，只去掉写超时；否则删除ev_write
+static void bufferevent_socket_write_drained(struct bufferevent *bufev)
+{
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
+
+    if (bufev_p->write_linger > 0 || bufev_p->edge_triggered) {
+        bufev_p->write_lingering = 1;
+        bufev_p->write_idle_wakeups = 0;
+        event_remove_timer(&bufev->ev_write);
+    }
+    else {
+        event_del(&bufev->ev_write);
+    }
+}
+
+//停止保留ev_write的注册，删除ev_write时调用
+static inline void bufferevent_socket_stop_linger(struct bufferevent *bufev)
+{
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
+    bufev_p->write_lingering = 0;
+}
+
 /*
  * 当我们确实要写入数据时，才监听可写事件。我们调用bufferevent_write写入数据时，Libevent才会把监听可写事件的那个event注册到event_base中。当Libevent把数据都写入到fd的缓冲区后，Libevent又会把这个event从event_base中删除。
  *
@@ -121,6 +206,7 @@ static void bufferevent_writecb(int fd, short event, void *arg)
     short what = BEV_EVENT_WRITING;
     int connected = 0;
     ssize_t atmost = -1;
+    ssize_t budget = (bufev_p->options & BEV_OPT_EDGE_TRIGGERED) ? BEV_EDGE_TRIGGERED_BUDGET : 0;
 
     bufferevent_incref_and_lock(bufev);
 
@@ -163,29 +249,53 @@ static void bufferevent_writecb(int fd, short event, void *arg)
     if (bufev_p->write_suspended)
         goto done;
 
-    //如果evbuffer有数据可以写到sockfd中
-    if (evbuffer_get_length(bufev->output)) {
+    //保留注册期间的空闲唤醒：没有数据可写，不调用用户回调，空闲次数用完后删除ev_write；边缘触发时一直保留
+    if (bufev_p->write_lingering && !connected && evbuffer_get_length(bufev->output) == 0) {
+        if (!bufev_p->edge_triggered && ++bufev_p->write_idle_wakeups >= bufev_p->write_linger) {
+            bufferevent_socket_stop_linger(bufev);
+            event_del(&bufev->ev_write);
+        }
+        goto done;
+    }
+    bufferevent_socket_stop_linger(bufev);
+
+    //如果evbuffer有数据可以写到sockfd中；BEV_OPT_EDGE_TRIGGERED时循环写到EAGAIN或者写完，最多写BEV_EDGE_TRIGGERED_BUDGET字节
+    while (evbuffer_get_length(bufev->output)) {
+        int n;
         evbuffer_unfreeze(bufev->output, 1);//解冻链表头
         /* 将output这个evbuffer的数据写到socket fd 的缓冲区中,会把已经写到socket fd缓冲区的数据，从evbuffer中删除 */
-        res = evbuffer_write_atmost(bufev->output, fd, atmost);
+        n = evbuffer_write_atmost(bufev->output, fd, atmost);
         evbuffer_freeze(bufev->output, 1);
-        if (res == -1) {
+        if (n == -1) {
             int err = errno;
-            if (EVUTIL_ERR_RW_RETRIABLE(err))
-                goto reschedule;
+            if (EVUTIL_ERR_RW_RETRIABLE(err)) {
+                if (res == 0)
+                    goto reschedule;
+                break;
+            }
             what |= BEV_EVENT_ERROR;
         }
-        else if (res == 0) {
+        else if (n == 0) {
             what |= BEV_EVENT_EOF;
         }
-        if (res <= 0)
+        if (n <= 0)
             goto error;
+
+        res += n;
+        if (!budget)
+            break;
+        //预算用完还没写完
+        if (res >= budget) {
+            if (evbuffer_get_length(bufev->output))
+                bufferevent_socket_rearm(bufev, &bufev->ev_write, EV_WRITE);
+            break;
+        }
     }
 
     //如果把写缓冲区的数据都写完成了。为了防止event_base不断地触发可写事件，此时要把这个监听可写的event删除。
     //前面的atmost限制了一次最大的可写数据。如果还没写完所有的数据那么就不能delete这个event，而是要继续监听可写事件，知道把所有的数据都写到socket fd中。
     if (evbuffer_get_length(bufev->output) == 0) {
-        event_del(&bufev->ev_write);
+        bufferevent_socket_write_drained(bufev);
     }
 
     /* 如果我们的缓冲区已满或低于低水位，则调用用户回调。*/
@@ -197,7 +307,7 @@ static void bufferevent_writecb(int fd, short event, void *arg)
 
 reschedule:
     if (evbuffer_get_length(bufev->output) == 0) {
-        event_del(&bufev->ev_write);
+        bufferevent_socket_write_drained(bufev);
     }
     goto done;
 
@@ -209,42 +319,131 @@ done:
     bufferevent_decref_and_unlock(bufev);
 }
 
+/*
+ * BEV_OPT_EAGER_WRITE：在当前这批回调结束后直接把输出缓冲区写到套接字，不用先注册可写事件再等一轮IO复用
+ * 只有写不完的部分才注册可写事件，由bufferevent_writecb继续写
+ */
+static void bufferevent_socket_eager_write_cb(struct deferred_cb *cb, void *arg)
+{
+    struct bufferevent_private *bufev_p = (struct bufferevent_private *)arg;
+    struct bufferevent *bufev = &bufev_p->bev;
+    short what = BEV_EVENT_WRITING;
+    int res;
+
+    BEV_LOCK(bufev);
+    if (!(bufev->enabled & EV_WRITE) || bufev_p->write_suspended || bufev_p->connecting
+        || evbuffer_get_length(bufev->output) == 0)
+        goto done;
+    //已经在等待可写事件（套接字发送缓冲区满），交给bufferevent_writecb
+    if (!bufev_p->write_lingering && event_pending(&bufev->ev_write, EV_WRITE, NULL))
+        goto done;
+
+    evbuffer_unfreeze(bufev->output, 1);
+    res = evbuffer_write_atmost(bufev->output, event_get_fd(&bufev->ev_write), -1);
+    evbuffer_freeze(bufev->output, 1);
+    if (res == -1) {
+        int err = errno;
+        if (!EVUTIL_ERR_RW_RETRIABLE(err))
+            what |= BEV_EVENT_ERROR;
+    }
+    else if (res == 0) {
+        what |= BEV_EVENT_EOF;
+    }
+    if (what != BEV_EVENT_WRITING) {
+        bufferevent_disable(bufev, EV_WRITE);
+        bufferevent_run_eventcb(bufev, what);
+        goto done;
+    }
+
+    //没写完，剩下的等待可写事件；边缘触发时没有遇到EAGAIN不会再收到通知
+    if (evbuffer_get_length(bufev->output)) {
+        bufferevent_socket_stop_linger(bufev);
+        if (bufferevent_add_event(&bufev->ev_write, &bufev->timeout_write) == -1) {
+        }
+        if (res > 0)
+            bufferevent_socket_rearm(bufev, &bufev->ev_write, EV_WRITE);
+    }
+
+    if (res > 0 && evbuffer_get_length(bufev->output) <= bufev->wm_write.low)
+        bufferevent_run_writecb(bufev);
+
+done:
+    bufferevent_decref_and_unlock(bufev);
+}
+
 static void bufferevent_socket_outbuf_cb(struct evbuffer *buf, const struct evbuffer_cb_info *cbinfo, void *arg)
 {
     struct bufferevent *bufev = (struct bufferevent *)arg;
     struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
 
-    if (cbinfo->n_added && (bufev->enabled & EV_WRITE)
-        &&!event_pending(&bufev->ev_write, EV_WRITE, NULL) && !bufev_p->write_suspended) {
-        /* 把数据添加到缓冲区，我们想写，我们当前没有在写。 所以，开始写。 */
+    if (cbinfo->n_added && (bufev->enabled & EV_WRITE) && !bufev_p->write_suspended && !bufev_p->connecting
+        && (bufev_p->options & BEV_OPT_EAGER_WRITE)
+        && (bufev_p->write_lingering || !event_pending(&bufev->ev_write, EV_WRITE, NULL))) {
+        /* 当前没有在等待可写事件，这批回调结束后直接写 */
+        if (!bufev_p->deferred_write.queued) {
+            bufferevent_incref(bufev);
+            event_deferred_cb_schedule(event_base_get_deferred_cb_queue(bufev->ev_base), &bufev_p->deferred_write);
+        }
+    }
+    else if (cbinfo->n_added && (bufev->enabled & EV_WRITE) && !bufev_p->write_suspended
+        && (bufev_p->write_lingering || !event_pending(&bufev->ev_write, EV_WRITE, NULL))) {
+        /* 把数据添加到缓冲区，我们想写，我们当前没有在写。 所以，开始写。
+         * ev_write保留注册时IO已经在后端中，这里只恢复写超时，不需要epoll_ctl；边缘触发时套接字一直可写，不会有新的通知 */
+        int lingering = bufev_p->write_lingering;
+        bufferevent_socket_stop_linger(bufev);
         if (bufferevent_add_event(&bufev->ev_write, &bufev->timeout_write) == -1) {
         }
+        if (lingering)
+            bufferevent_socket_rearm(bufev, &bufev->ev_write, EV_WRITE);
     }
 }
 
+//event_base开启了忙轮询时，对套接字设置SO_BUSY_POLL
+static void bufferevent_socket_set_busy_poll(struct bufferevent *bufev, int fd)
+{
+    int busy_poll = event_base_get_busy_poll(bufev->ev_base);
+    if (busy_poll > 0 && evutil_make_socket_busy_poll(fd, busy_poll) < 0)
+        event_debug(("%s: unable to set SO_BUSY_POLL on fd %d", __func__, fd));
+}
+
 struct bufferevent *bufferevent_socket_new(struct event_base *base, int fd, int options)
 {
     struct bufferevent_private *bufev_p;
     struct bufferevent *bufev;
 
-    if ((bufev_p = (struct bufferevent_private *)mm_calloc(1, sizeof(struct bufferevent_private)))== NULL)
+    if ((bufev_p = (struct bufferevent_private *)event_base_pool_get_(base, EVENT_POOL_BUFFEREVENT, sizeof(struct bufferevent_private)))== NULL)
         return NULL;
+    memset(bufev_p, 0, sizeof(struct bufferevent_private));
 
     if (bufferevent_init_common(bufev_p, base, &bufferevent_ops_socket, options) < 0) {
-        mm_free(bufev_p);
+        event_base_pool_put_(base, EVENT_POOL_BUFFEREVENT, bufev_p, sizeof(struct bufferevent_private));
         return NULL;
     }
     bufev = &bufev_p->bev;
     //设置将evbuffer的数据向fd传
     evbuffer_set_flags(bufev->output, EVBUFFER_FLAG_DRAINS_TO_FD);
 
+    if (options & BEV_OPT_EAGER_WRITE)
+        event_deferred_cb_init(&bufev_p->deferred_write, bufferevent_socket_eager_write_cb, bufev_p);
+
+    bufev_p->read_size_min = BEV_READ_SIZE_MIN;
+    bufev_p->read_size_max = BEV_READ_SIZE_MAX;
+    bufev_p->read_size = BEV_READ_SIZE_INITIAL;
+
+    //后端不支持边缘触发（如io_uring）时仍然使用电平触发，只保留一次唤醒循环读写
+    if ((options & BEV_OPT_EDGE_TRIGGERED) && (event_base_get_features(base) & EV_FEATURE_ET))
+        bufev_p->edge_triggered = 1;
+
     /* 读写事件设置值,fd与event相关联。同一个fd关联两个event */
-    event_assign(&bufev->ev_read, bufev->ev_base, fd, EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
-    event_assign(&bufev->ev_write, bufev->ev_base, fd, EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+    event_assign(&bufev->ev_read, bufev->ev_base, fd, EV_READ|EV_PERSIST|bufferevent_socket_et(bufev), bufferevent_readcb, bufev);
+    event_assign(&bufev->ev_write, bufev->ev_base, fd, EV_WRITE|EV_PERSIST|bufferevent_socket_et(bufev), bufferevent_writecb, bufev);
 
     /*设置evbuffer的回调函数，使得外界给写缓冲区添加数据时，能触发写操作,回调对于写事件的监听很重要的 */
     evbuffer_add_cb(bufev->output, bufferevent_socket_outbuf_cb, bufev);
 
+    if (fd >= 0)
+        bufferevent_socket_set_busy_poll(bufev, fd);
+
     /*冻结读缓冲区的尾部，未解冻之前不能往读缓冲区追加数据(不能从socket fd中读取数据)  */
     evbuffer_freeze(bufev->input, 0);
 
@@ -278,19 +477,23 @@ int bufferevent_socket_connect(struct bufferevent *bev, struct sockaddr *sa, int
         if (evutil_make_socket_nonblocking(fd)<0)
             goto done;
         ownfd = 1;
+        bufferevent_socket_set_busy_poll(bev, fd);
     }
     if (sa) {
         r = evutil_socket_connect(&fd, sa, socklen);
         if (r < 0)
             goto freesock;
     }
+    //连接进行中：在启用写事件之前设置connecting，边缘触发时不能主动激活写事件，否则握手完成前就会报告BEV_EVENT_CONNECTED
+    if (r == 0)
+        bufev_p->connecting = 1;
     bufferevent_setfd(bev, fd);
     if (r == 0) {
         if (! be_socket_enable(bev, EV_WRITE)) {
-            bufev_p->connecting = 1;
             result = 0;
             goto done;
         }
+        bufev_p->connecting = 0;
     }
     else if (r == 1) {
         result = 0;
@@ -355,6 +558,54 @@ done:
     return res;
 }
 
+int bufferevent_socket_set_write_linger(struct bufferevent *bev, int idle_wakeups)
+{
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bev, struct bufferevent_private, bev);
+    int r = -1;
+
+    if (idle_wakeups < 0)
+        return -1;
+
+    BEV_LOCK(bev);
+    if (bev->be_ops != &bufferevent_ops_socket)
+        goto done;
+
+    bufev_p->write_linger = idle_wakeups;
+    //关闭时删除正在保留的ev_write
+    if (idle_wakeups == 0 && bufev_p->write_lingering) {
+        bufferevent_socket_stop_linger(bev);
+        event_del(&bev->ev_write);
+    }
+    r = 0;
+done:
+    BEV_UNLOCK(bev);
+    return r;
+}
+
+int bufferevent_socket_set_read_size(struct bufferevent *bev, size_t min, size_t max)
+{
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bev, struct bufferevent_private, bev);
+    int r = -1;
+
+    if (min == 0 || min > max || max > BEV_READ_SIZE_LIMIT)
+        return -1;
+
+    BEV_LOCK(bev);
+    if (bev->be_ops != &bufferevent_ops_socket)
+        goto done;
+
+    bufev_p->read_size_min = (int)min;
+    bufev_p->read_size_max = (int)max;
+    if (bufev_p->read_size < bufev_p->read_size_min)
+        bufev_p->read_size = bufev_p->read_size_min;
+    if (bufev_p->read_size > bufev_p->read_size_max)
+        bufev_p->read_size = bufev_p->read_size_max;
+    r = 0;
+done:
+    BEV_UNLOCK(bev);
+    return r;
+}
+
 int bufferevent_socket_get_dns_error(struct bufferevent *bev)
 {
     int rv;
@@ -367,15 +618,22 @@ int bufferevent_socket_get_dns_error(struct bufferevent *bev)
     return rv;
 }
 
+//边缘触发时重新添加事件不一定有通知（比如changelist中删除和添加抵消了），启用时主动激活一次，和电平触发的行为一致。
+//连接进行中时不激活写事件，连接完成时内核的EPOLLOUT边缘才是真正的通知
 static int be_socket_enable(struct bufferevent *bufev, short event)
 {
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
     if (event & EV_READ) {
         if (bufferevent_add_event(&bufev->ev_read,&bufev->timeout_read) == -1)
             return -1;
+        bufferevent_socket_rearm(bufev, &bufev->ev_read, EV_READ);
     }
     if (event & EV_WRITE) {
+        bufferevent_socket_stop_linger(bufev);
         if (bufferevent_add_event(&bufev->ev_write,&bufev->timeout_write) == -1)
             return -1;
+        if (!bufev_p->connecting)
+            bufferevent_socket_rearm(bufev, &bufev->ev_write, EV_WRITE);
     }
     return 0;
 }
@@ -389,6 +647,7 @@ static int be_socket_disable(struct bufferevent *bufev, short event)
     }
     /* 如果我们尝试连接，实际上不要禁用写。*/
     if ((event & EV_WRITE) && ! bufev_p->connecting) {
+        bufferevent_socket_stop_linger(bufev);
         if (event_del(&bufev->ev_write) == -1)
             return -1;
     }
@@ -412,11 +671,13 @@ static void be_socket_destruct(struct bufferevent *bufev)
 
 static int be_socket_adj_timeouts(struct bufferevent *bufev)
 {
+    struct bufferevent_private *bufev_p = EVUTIL_UPCAST(bufev, struct bufferevent_private, bev);
     int r = 0;
     if (event_pending(&bufev->ev_read, EV_READ, NULL))
         if (bufferevent_add_event(&bufev->ev_read, &bufev->timeout_read) < 0)
             r = -1;
-    if (event_pending(&bufev->ev_write, EV_WRITE, NULL)) {
+    //保留注册的ev_write没有数据可写，不设置写超时
+    if (event_pending(&bufev->ev_write, EV_WRITE, NULL) && !bufev_p->write_lingering) {
         if (bufferevent_add_event(&bufev->ev_write, &bufev->timeout_write) < 0)
             r = -1;
     }
@@ -435,9 +696,10 @@ static void be_socket_setfd(struct bufferevent *bufev, int fd)
 
     event_del(&bufev->ev_read);
     event_del(&bufev->ev_write);
+    bufferevent_socket_stop_linger(bufev);
 
-    event_assign(&bufev->ev_read, bufev->ev_base, fd, EV_READ|EV_PERSIST, bufferevent_readcb, bufev);
-    event_assign(&bufev->ev_write, bufev->ev_base, fd, EV_WRITE|EV_PERSIST, bufferevent_writecb, bufev);
+    event_assign(&bufev->ev_read, bufev->ev_base, fd, EV_READ|EV_PERSIST|bufferevent_socket_et(bufev), bufferevent_readcb, bufev);
+    event_assign(&bufev->ev_write, bufev->ev_base, fd, EV_WRITE|EV_PERSIST|bufferevent_socket_et(bufev), bufferevent_writecb, bufev);
 
     if (fd >= 0)
         bufferevent_enable(bufev, bufev->enabled);
@@ -1,32 +1,59 @@
 #ifndef TNET_DEFER_INTERNAL_H
 #define TNET_DEFER_INTERNAL_H
 
+#include <stdint.h>
 #include "sys/queue.h"
 
 struct deferred_cb;
 
 typedef void (*deferred_cb_fn)(struct deferred_cb *,void *);
 
+//deferred_cb.queued的取值
+#define DEFERRED_CB_IDLE   0//不在队列中
+#define DEFERRED_CB_LISTED 1//在deferred_cb_list中，只有持有队列锁时才能离开这个状态
+#define DEFERRED_CB_INBOX  2//已经放入无锁收件箱，等待持有锁的线程取出
+
 //deferred_cb是一个回调函数：可以计划作为event_base的event_loop的一部分运行，而不是立刻运行
 //event_base的活动事件中的所有事件处理完后，需要调用一次延迟回调函数
 struct deferred_cb {
     TAILQ_ENTRY (deferred_cb) cb_next;
-    unsigned queued : 1;//如果deferred_cb正在event_base中等待，设置为true
+    struct deferred_cb *inbox_next;//收件箱中的下一个
+    int queued;//DEFERRED_CB_*，原子访问，非0表示正在event_base中等待
     deferred_cb_fn cb;//函数指针：回调执行时需要执行的函数
 
     void *arg;//回调函数的参数
+    int64_t queued_ns;//调度的时间，只在队列记录等待时间时设置
 };
 
-//deferred_cb_queue是我们可以添加并运行的deferred_cb的列表
+//cache line大小，不同线程频繁写的字段至少相隔这么远，避免伪共享
+#define EVENT_CACHELINE 64
+
+/*
+ * deferred_cb_queue是我们可以添加并运行的deferred_cb的列表
+ * 调度不加锁：先放入多生产者单消费者的无锁收件箱（和event_base_post相同的算法），持有锁的线程（处理、取消时）把收件箱
+ * 中的条目按顺序移到deferred_cb_list
+ * 生产者写的字段放在开头单独的cache line上，后面是只读的配置和消费端的字段
+ */
 struct deferred_cb_queue {
-    void *lock;//互斥锁
-    int active_count;/** 队列中条目deferred_cb的数量 */
+    struct deferred_cb *inbox_head;//最后放入收件箱的条目，生产者原子交换
+    int active_count;/** 已调度还没有执行的条目数量（收件箱加列表），原子修改 */
+    int inbox_notify_pending;//为1时已经唤醒了事件循环，取出条目前清零
+    char pad_producer[EVENT_CACHELINE - sizeof(struct deferred_cb *) - 2 * sizeof(int)];
+
+    void *lock;//互斥锁，保护deferred_cb_list和收件箱的消费端
+    int max_per_iteration;//每轮事件循环最多执行的条目数，0表示根据队列深度自适应
 
-    //从另一个线程添加到队列时调用的通知函数。
+    //添加到队列时调用的通知函数，调用时不持有锁
     void (*notify_fn)(struct deferred_cb_queue *, void *);
     void *notify_arg;
 
+    int record_wait;//是否记录每个条目的调度时间（统计等待时间）
+    int clock_source;//记录调度时间使用的时钟，enum event_clock_source
+
     TAILQ_HEAD (deferred_cb_list, deferred_cb) deferred_cb_list;
+
+    struct deferred_cb *inbox_tail;//下一个取出的条目，只在持有锁时访问
+    struct deferred_cb inbox_stub;//占位条目，收件箱为空时head和tail都指向它
 };
 
 //初始化延迟回调函数
@@ -44,6 +71,9 @@ void event_deferred_cb_schedule(struct deferred_cb_queue *,struct deferred_cb*);
 //延迟回调函数队列初始化
 void event_deferred_cb_queue_init(struct deferred_cb_queue *);
 
+//把收件箱中已经完成入队的条目按顺序移到deferred_cb_list，需要持有队列锁
+void event_deferred_cb_queue_drain(struct deferred_cb_queue *);
+
 //获取event_base的延迟回调函数队列
 struct deferred_cb_queue *event_base_get_deferred_cb_queue(struct event_base *);
 #endif //TNET_DEFER_INTERNAL_H
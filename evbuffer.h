@@ -28,6 +28,7 @@ struct evbuffer_cb_entry {
 };
 
 struct bufferevent;
+struct event_base;
 struct evbuffer_chain;
 struct evbuffer {
     struct evbuffer_chain *first; /** 这个缓冲区链中的第一个链元素*/
@@ -60,6 +61,8 @@ struct evbuffer {
     TAILQ_HEAD(evbuffer_cb_queue, evbuffer_cb_entry) callbacks;/* 回调函数的队列*/
 
     struct bufferevent *parent;/* 这个evbuffer所属的父级bufferevent对象。 如果evbuffer独立，则为NULL。*/
+
+    struct event_base *pool_base;/* 从这个event_base的对象池中分配，释放时放回池中；NULL表示使用mm_free */
 };
 
 #define EVBUFFER_CHAIN_MAX ((size_t)EV_SSIZE_MAX)
@@ -135,6 +138,9 @@ void evbuffer_incref_and_lock(struct evbuffer *buf);
 /** evbuffer_free的核心函数，要求我们在缓冲区上加锁，解锁并释放缓冲区。 */
 void evbuffer_decref_and_unlock(struct evbuffer *buffer);
 
+/* 和evbuffer_new一样，但是从base的对象池中分配，base没有开启对象池时等同于evbuffer_new */
+struct evbuffer *evbuffer_new_pooled_(struct event_base *base);
+
 /* evbuffer调用回调函数 */
 void evbuffer_invoke_callbacks(struct evbuffer *buf);
 
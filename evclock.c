@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include "evclock.h"
+#ifdef EVCLOCK_HAVE_TSC
+#include <cpuid.h>
+#endif
+#include "evlog.h"
+
+struct evclock_tsc_params evclock_tsc;
+
+static pthread_once_t evclock_tsc_once = PTHREAD_ONCE_INIT;
+
+#ifdef EVCLOCK_HAVE_TSC
+//同时读取单调时钟和TSC，取多次中间隔最短的一次，减少读取之间被打断的误差
+static void evclock_tsc_sample(int64_t *ns, uint64_t *tsc)
+{
+    uint64_t best = UINT64_MAX;
+    struct timespec ts;
+
+    *ns = 0;
+    *tsc = 0;
+    for (int i = 0; i < 8; ++i) {
+        uint64_t t0 = __rdtsc();
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t t1 = __rdtsc();
+        if (t1 - t0 < best) {
+            best = t1 - t0;
+            *tsc = t0 + (t1 - t0) / 2;
+            *ns = evclock_timespec_ns(&ts);
+        }
+    }
+}
+
+static void evclock_tsc_calibrate(void)
+{
+    unsigned eax, ebx, ecx, edx;
+    struct timespec delay = {0, 10000000};
+    int64_t ns0, ns1;
+    uint64_t tsc0, tsc1;
+
+    //CPUID.80000007H:EDX[8]，不变TSC：频率恒定，不受变频和C状态影响
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 8))) {
+        event_debug(("%s: no invariant TSC", __func__));
+        return;
+    }
+
+    evclock_tsc_sample(&ns0, &tsc0);
+    while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+        ;
+    evclock_tsc_sample(&ns1, &tsc1);
+    if (tsc1 <= tsc0 || ns1 <= ns0)
+        return;
+
+    evclock_tsc.mult = ((uint64_t)(ns1 - ns0) << 32) / (tsc1 - tsc0);
+    evclock_tsc.ns0 = ns1;
+    evclock_tsc.tsc0 = tsc1;
+    evclock_tsc.usable = 1;
+    event_debug(("%s: TSC %.3f MHz", __func__, (tsc1 - tsc0) * 1e3 / (ns1 - ns0)));
+}
+#else
+static void evclock_tsc_calibrate(void)
+{
+}
+#endif
+
+int evclock_tsc_init(void)
+{
+    pthread_once(&evclock_tsc_once, evclock_tsc_calibrate);
+    return evclock_tsc.usable ? 0 : -1;
+}
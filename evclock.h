@@ -0,0 +1,53 @@
+//
+// event_base使用的时钟源：CLOCK_MONOTONIC、CLOCK_MONOTONIC_COARSE或者校准过的TSC，统一返回64位纳秒
+//
+
+#ifndef TNET_EVCLOCK_H
+#define TNET_EVCLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include "event2/event.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define EVCLOCK_HAVE_TSC
+#endif
+
+//TSC换算参数：ns = ns0 + ((tsc - tsc0) * mult) >> 32，进程内校准一次
+struct evclock_tsc_params {
+    int64_t ns0;
+    uint64_t tsc0;
+    uint64_t mult;
+    int usable;
+};
+extern struct evclock_tsc_params evclock_tsc;
+
+//检查CPU是否有不变TSC（invariant TSC）并校准，第一次调用会阻塞约10毫秒；可用返回0，否则返回-1
+int evclock_tsc_init(void);
+
+static inline int64_t evclock_timespec_ns(const struct timespec *ts)
+{
+    return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+//读取时钟source的当前时间，纳秒；EVENT_CLOCK_TSC只能在evclock_tsc_init成功后使用
+static inline int64_t evclock_now_ns(int source)
+{
+    struct timespec ts;
+
+#ifdef EVCLOCK_HAVE_TSC
+    if (source == EVENT_CLOCK_TSC)
+        return evclock_tsc.ns0 + (int64_t)(((unsigned __int128)(__rdtsc() - evclock_tsc.tsc0) * evclock_tsc.mult) >> 32);
+#endif
+    clock_gettime(source == EVENT_CLOCK_MONOTONIC_COARSE ? CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, &ts);
+    return evclock_timespec_ns(&ts);
+}
+
+//source的精度足够用于统计时返回source，否则（粗粒度时钟）返回EVENT_CLOCK_MONOTONIC
+static inline int evclock_precise_source(int source)
+{
+    return source == EVENT_CLOCK_TSC ? EVENT_CLOCK_TSC : EVENT_CLOCK_MONOTONIC;
+}
+
+#endif //TNET_EVCLOCK_H
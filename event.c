@@ -11,6 +11,7 @@
 #include <string.h>
 #include <time.h>
 #include <limits.h>
+#include <sched.h>
 #include "event2/event.h"
 #include "event2/event_struct.h"
 #include "event2/util.h"
@@ -21,6 +22,7 @@
 #include "event2/thread.h"
 #include "evmap.h"
 #include "evsignal.h"
+#include "evclock.h"
 //C++编译时需要包含这个头文件
 #ifdef __cplusplus
 #include "eviomultiplexing.h"
@@ -30,16 +32,19 @@ extern const struct eventop selectops;
 extern const struct eventop pollops;
 extern const struct eventop epollops;
 
-/* 支持的IO复用数组 */
-static const struct eventop *eventops[] = { &epollops, &pollops, &selectops, NULL };
+/* 支持的IO复用数组，按优先级排列。io_uring不支持边缘触发，排在epoll之后，需要时用event_config_avoid_method(cfg, "epoll")选择 */
+#ifdef TNET_SINGLE_THREAD
+static const struct eventop *eventops[] = { &epollops, NULL };
+#else
+static const struct eventop *eventops[] = { &epollops, &uringops, &pollops, &selectops, NULL };
+#endif
 
 //不建议使用
 struct event_base *event_global_current_base = NULL;
 #define current_base event_global_current_base
 
-static int use_monotonic = 0;
-
 static int evthread_notify_base(struct event_base *base);
+static void event_base_batch_end(struct event_base *base);
 
 #define EVENT_BASE_ASSERT_LOCKED(base)	EVLOCK_ASSERT_LOCKED((base)->th_base_lock)
 
@@ -107,93 +112,97 @@ static void common_timeout_schedule(struct common_timeout_list *ctl, const struc
     event_add_nolock(&ctl->timeout_event, &timeout, 1);
 }
 
-//如果我们支持monotonic，第一次调用这个函数的时候，会设置use_monotonic为1,这儿我们默认支持
-static void detect_monotonic(){
-    struct timespec ts;
-    static int use_monotonic_initialized = 0;
-    if(use_monotonic_initialized)
-        return;
+//更新挂钟时间与单调时间差值（tv_clock_diff）的时间间隔，单位为秒
+#define CLOCK_SYNC_INTERVAL 1
 
-    if(clock_gettime(CLOCK_MONOTONIC,&ts) == 0)
-        use_monotonic = 1;
-    use_monotonic_initialized = 1;
+static inline void ns_to_timeval(int64_t ns, struct timeval *tv)
+{
+    tv->tv_sec = ns / 1000000000;
+    tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+static inline int64_t timeval_to_ns(const struct timeval *tv)
+{
+    return (int64_t)tv->tv_sec * 1000000000 + (int64_t)tv->tv_usec * 1000;
 }
-//检查更改挂钟时间为单调时间的时间间隔（单位为秒），设为-1表示永不检查
-#define CLOCK_SYNC_INTERVAL -1
 
-//根据base设置tp为当前时间，如果存在tv_cache，使用tv_cache，否则根据gettimeofday或者clock_gettime获取
-static int gettime(struct event_base *base, struct timeval *tp)
+//根据base设置*ns为当前时间（纳秒），如果存在时间缓存，使用时间缓存，否则读取base的时钟源，不会失败
+static void gettime_ns(struct event_base *base, int64_t *ns)
 {
     EVENT_BASE_ASSERT_LOCKED(base);
 
-    if (base->tv_cache.tv_sec) {
-        *tp = base->tv_cache;
-        return (0);
+    if (base->time_cache_ns) {
+        *ns = base->time_cache_ns;
+        return;
     }
 
-    if(use_monotonic){
-        struct timespec ts;
-        if(clock_gettime(CLOCK_MONOTONIC,&ts) == -1)
-            return -1;
-
-        tp->tv_sec = ts.tv_sec;
-        tp->tv_usec = ts.tv_nsec /1000;//ts.tv_nsec是纳秒，需要转化为微秒
-        //更新base中的字段
-        if (base->last_updated_clock_diff + CLOCK_SYNC_INTERVAL < tp->tv_sec) {
-            struct timeval tv;
-            gettimeofday(&tv,NULL);
-            evutil_timersub(&tv, tp, &base->tv_clock_diff);
-            base->last_updated_clock_diff = tp->tv_sec;
-        }
-
-        return 0;
+    *ns = evclock_now_ns(base->clock_source);
+    if (base->last_updated_clock_diff + CLOCK_SYNC_INTERVAL <= *ns / 1000000000) {
+        struct timeval tv, now;
+        gettimeofday(&tv, NULL);
+        ns_to_timeval(*ns, &now);
+        evutil_timersub(&tv, &now, &base->tv_clock_diff);
+        base->last_updated_clock_diff = *ns / 1000000000;
     }
+}
+
+//根据base设置tp为当前时间，同gettime_ns
+static void gettime(struct event_base *base, struct timeval *tp)
+{
+    int64_t ns;
 
-    return gettimeofday(tp, NULL);
+    gettime_ns(base, &ns);
+    ns_to_timeval(ns, tp);
 }
 
 //清空event_base的时间缓存
 static inline void clear_time_cache(struct event_base *base)
 {
-    base->tv_cache.tv_sec = 0;
+    base->time_cache_ns = 0;
 }
 
-//使用当前时间更新event_base中的tv_cache
+//使用当前时间更新event_base中的时间缓存
 static inline void update_time_cache(struct event_base *base)
 {
-    base->tv_cache.tv_sec = 0;
+    base->time_cache_ns = 0;
     if (!(base->flags & EVENT_BASE_FLAG_NO_CACHE_TIME))
-        gettime(base, &base->tv_cache);
+        gettime_ns(base, &base->time_cache_ns);
 }
 
 //获取小根堆中的最小超时时间，设置IO复用的最大等待时间，通过tv_p返回
 static int timeout_next(struct event_base *base,struct timeval **tv_p){
     struct timeval now;
-    struct event *ev;
+    int64_t now_ns, delta;
     struct timeval *tv = *tv_p;
     int res = 0;
 
-    ev = min_heap_top_(&base->timeheap);
-    if(ev == NULL){
-        //如果没有基于时间的事件处于活动状态等待I / O
-        *tv_p = NULL;
+    if (base->timewheel) {
+        if (timer_wheel_empty(base->timewheel)) {
+            *tv_p = NULL;
+            goto out;
+        }
+        gettime(base, &now);
+        if (timer_wheel_next_timeout(base->timewheel, &now, tv) < 0)
+            *tv_p = NULL;
         goto out;
     }
 
-    if(gettime(base,&now) == -1){
-        res = -1;
+    if(min_heap_empty_(&base->timeheap)){
+        //如果没有基于时间的事件处于活动状态等待I / O
+        *tv_p = NULL;
         goto out;
     }
 
-    if(evutil_timercmp(&ev->ev_timeout,&now,<=)){
+    gettime_ns(base,&now_ns);
+
+    delta = min_heap_top_key_(&base->timeheap) - now_ns;
+    if(delta <= 0){
         evutil_timerclear(tv);
         goto out;
     }
 
-    evutil_timersub(&ev->ev_timeout,&now,tv);
-
-    EVUTIL_ASSERT(tv->tv_sec >= 0);
-    EVUTIL_ASSERT(tv->tv_usec >= 0);
+    //向上取整到微秒，避免提前醒来
+    ns_to_timeval(delta + 999, tv);
     event_debug(("timeout_next: in %d seconds", (int)tv->tv_sec));
 
 out:
@@ -201,21 +210,86 @@ out:
 }
 
 // 检查小根堆中的定时器事件，将就绪的定时器事件从heap上删除，并插入到激活链表中
+#define EVENT_BASE_COLLECT_STATS(base) ((base)->flags & EVENT_BASE_FLAG_COLLECT_STATS)
+
+static inline void event_stats_record(struct event_stats_histogram *h, uint64_t v)
+{
+    int bucket = v ? 64 - __builtin_clzll(v) : 0;
+    if (bucket >= EVENT_STATS_HIST_BUCKETS)
+        bucket = EVENT_STATS_HIST_BUCKETS - 1;
+    ++h->buckets[bucket];
+    ++h->count;
+    h->sum += v;
+    if (v > h->max)
+        h->max = v;
+}
+
+//统计使用的时钟，粗粒度时钟的精度不够，换成CLOCK_MONOTONIC
+static inline uint64_t event_stats_now_ns(struct event_base *base)
+{
+    return evclock_now_ns(evclock_precise_source(base->clock_source));
+}
+
+//记录定时器的延迟，now_ns是激活时的时间
+static inline void event_stats_record_timer(struct event_base *base, const struct event *ev, int64_t now_ns)
+{
+    int64_t late;
+    if (!EVENT_BASE_COLLECT_STATS(base) || (ev->ev_flags & EVLIST_INTERNAL))
+        return;
+    //公共超时的ev_timeout高位有标志，去掉
+    late = now_ns - ((int64_t)ev->ev_timeout.tv_sec * 1000000000 +
+                     (int64_t)(ev->ev_timeout.tv_usec & MICROSECONDS_MASK) * 1000);
+    event_stats_record(&base->stats.timer_lateness_ns, late > 0 ? (uint64_t)late : 0);
+}
+
+uint64_t event_stats_histogram_percentile(const struct event_stats_histogram *h, double p)
+{
+    uint64_t seen = 0, target;
+
+    if (h->count == 0)
+        return 0;
+    target = (uint64_t)(p * h->count + 0.5);
+    if (target == 0)
+        target = 1;
+    for (int i = 0; i < EVENT_STATS_HIST_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= target)
+            return i == EVENT_STATS_HIST_BUCKETS - 1 ? h->max : (i ? ((uint64_t)1 << i) - 1 : 0);
+    }
+    return h->max;
+}
+
 static void timeout_process(struct event_base *base){
     struct timeval now;
+    int64_t now_ns;
     struct event *ev;
 
+    if (base->timewheel) {
+        if (timer_wheel_empty(base->timewheel))
+            return;
+        gettime_ns(base, &now_ns);
+        ns_to_timeval(now_ns, &now);
+        while ((ev = timer_wheel_first_expired(base->timewheel, &now))) {
+            event_stats_record_timer(base, ev, now_ns);
+            event_del_nolock(ev);
+            event_active_nolock(ev, EV_TIMEOUT, 1);
+        }
+        return;
+    }
+
     //没有定时器事件，直接返回
     if(min_heap_empty_(&base->timeheap)){
         return;
     }
 
-    //获取当前时间
-    gettime(base,&now);
-    while((ev = min_heap_top_(&base->timeheap))){
-        if(evutil_timercmp(&ev->ev_timeout,&now,>))
+    //获取当前时间，和堆中内联的超时时间比较，不需要访问event
+    gettime_ns(base,&now_ns);
+    while(!min_heap_empty_(&base->timeheap)){
+        if(min_heap_top_key_(&base->timeheap) > now_ns)
             break;
 
+        ev = min_heap_top_(&base->timeheap);
+        event_stats_record_timer(base, ev, now_ns);
         /* IO 队列中删除这个事件 */
         event_del_nolock(ev);
 
@@ -353,14 +427,85 @@ const char **event_get_supported_methods(void)
     return (methods);
 }
 
-//在一个单一的激活事件队列中处理所有事件，释放锁，这个函数当它被唤醒时需要持有锁
-static int event_process_active_single_queue(struct event_base *base,struct event_list *activeq){
+//一次回调的慢回调检测状态，开始时持有锁，从event_base中复制钩子，回调返回后不需要锁
+struct event_slow_cb_watch {
+    event_slow_callback_fn fn;
+    void *arg;
+    uint64_t threshold_ns;
+    int clock;
+    uint64_t start;
+};
+
+static inline void event_slow_cb_start(struct event_base *base, struct event_slow_cb_watch *w)
+{
+    w->fn = base->slow_cb_fn;
+    if (w->fn == NULL)
+        return;
+    w->arg = base->slow_cb_arg;
+    w->threshold_ns = base->slow_cb_threshold_ns;
+    w->clock = base->slow_cb_clock;
+    w->start = evclock_now_ns(w->clock);
+}
+
+static void event_slow_cb_finish(struct event_base *base, struct event_slow_cb_watch *w,
+                                 void *callback, void *arg, int fd, short events, int is_deferred)
+{
+    struct event_slow_callback_info info;
+    uint64_t elapsed;
+
+    if (w->fn == NULL)
+        return;
+    elapsed = evclock_now_ns(w->clock) - w->start;
+    if (elapsed < w->threshold_ns)
+        return;
+
+    info.callback = callback;
+    info.arg = arg;
+    info.fd = fd;
+    info.events = events;
+    info.is_deferred = is_deferred;
+    info.duration_ns = elapsed;
+    w->fn(base, &info, w->arg);
+}
+
+int event_base_set_slow_callback_hook(struct event_base *base, const struct timeval *threshold,
+                                      event_slow_callback_fn fn, void *arg)
+{
+    struct timespec res;
+    uint64_t threshold_ns;
+
+    if (base == NULL || (fn && (threshold == NULL || threshold->tv_sec < 0 || threshold->tv_usec < 0)))
+        return -1;
+    threshold_ns = fn ? (uint64_t)threshold->tv_sec * 1000000000 + (uint64_t)threshold->tv_usec * 1000 : 0;
+
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    base->slow_cb_fn = fn;
+    base->slow_cb_arg = arg;
+    base->slow_cb_threshold_ns = threshold_ns;
+    //粗粒度时钟只读vDSO中的变量，精度为一个jiffy，阈值足够大时误差可以忽略；event_base使用TSC时直接用TSC
+    if (base->clock_source == EVENT_CLOCK_TSC)
+        base->slow_cb_clock = EVENT_CLOCK_TSC;
+    else if (clock_getres(CLOCK_MONOTONIC_COARSE, &res) == 0 &&
+        threshold_ns >= 4 * ((uint64_t)res.tv_sec * 1000000000 + res.tv_nsec))
+        base->slow_cb_clock = EVENT_CLOCK_MONOTONIC_COARSE;
+    else
+        base->slow_cb_clock = EVENT_CLOCK_MONOTONIC;
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+    return 0;
+}
+
+//在一个单一的激活事件队列中处理事件，最多执行max_to_process个非内部事件的回调，释放锁，这个函数当它被唤醒时需要持有锁
+static int event_process_active_single_queue(struct event_base *base,struct event_list *activeq, int max_to_process){
     struct event *ev;
     int count = 0;
+    struct event_slow_cb_watch watch;
+    void *watch_cb = NULL, *watch_arg = NULL;
+    int watch_fd = -1;
+    short watch_res = 0;
 
     EVUTIL_ASSERT(activeq != NULL);
 
-    for(ev = TAILQ_FIRST(activeq);ev;ev = TAILQ_FIRST(activeq)){
+    for(ev = TAILQ_FIRST(activeq);ev && count < max_to_process;ev = TAILQ_FIRST(activeq)){
         //判断是否是永久事件
         if(ev->ev_events & EV_PERSIST)
             event_queue_remove(base,ev,EVLIST_ACTIVE);
@@ -380,6 +525,15 @@ static int event_process_active_single_queue(struct event_base *base,struct even
         base->current_event = ev;
         base->current_event_waiters = 0;
 
+        //回调可能释放ev，先保存慢回调报告需要的信息
+        event_slow_cb_start(base, &watch);
+        if (watch.fn) {
+            watch_cb = (void *)ev->ev_callback;
+            watch_arg = ev->ev_arg;
+            watch_fd = ev->ev_fd;
+            watch_res = ev->ev_res;
+        }
+
         switch(ev->ev_closure){
             case EV_CLOSURE_SIGNAL:
                 event_signal_closure(base,ev);
@@ -393,6 +547,7 @@ static int event_process_active_single_queue(struct event_base *base,struct even
                 (*ev->ev_callback)(ev->ev_fd, ev->ev_res, ev->ev_arg);
                 break;
         }
+        event_slow_cb_finish(base, &watch, watch_cb, watch_arg, watch_fd, watch_res, 0);
         EVBASE_ACQUIRE_LOCK(base, th_base_lock);
         base->current_event = NULL;
         if (base->current_event_waiters) {
@@ -408,30 +563,71 @@ static int event_process_active_single_queue(struct event_base *base,struct even
     return count;
 }
 
-//在queue中处理最多MAX_DEFERRED个deferred_cb条目。 如果breakptr设置为1，停止。
+//自适应时每轮执行队列中的一半，限制在[DEFERRED_BUDGET_MIN, DEFERRED_BUDGET_MAX]
+#define DEFERRED_BUDGET_MIN 16
+#define DEFERRED_BUDGET_MAX 4096
+
+static struct deferred_cb *event_deferred_cb_inbox_pop(struct deferred_cb_queue *queue);
+
+//在queue中处理一批deferred_cb条目，最多max_per_iteration个，没有设置时由队列深度决定。 如果breakptr设置为1，停止。
 //开始我们需要在queue上持有锁; 我们处理每个deferred_cb释放锁。
-static int event_process_deferred_callbacks(struct deferred_cb_queue *queue, int *breakptr)
+static int event_process_deferred_callbacks(struct event_base *base, struct deferred_cb_queue *queue, int *breakptr)
 {
-    int count = 0;
+    int removed = 0, broken = 0, depth, budget;
     struct deferred_cb *cb;
-
-#define MAX_DEFERRED 16
-    while ((cb = TAILQ_FIRST(&queue->deferred_cb_list))) {
-        cb->queued = 0;
-        TAILQ_REMOVE(&queue->deferred_cb_list, cb, cb_next);
-        --queue->active_count;
+    struct event_slow_cb_watch watch;
+
+    //先清除标志再取条目：之后完成入队的生产者会重新唤醒事件循环
+    __atomic_store_n(&queue->inbox_notify_pending, 0, __ATOMIC_SEQ_CST);
+    depth = __atomic_load_n(&queue->active_count, __ATOMIC_RELAXED);
+    if ((uint64_t)depth > base->stats.deferred_depth_max)
+        base->stats.deferred_depth_max = depth;
+
+    budget = queue->max_per_iteration;
+    if (budget <= 0) {
+        budget = depth / 2;
+        if (budget < DEFERRED_BUDGET_MIN)
+            budget = DEFERRED_BUDGET_MIN;
+        else if (budget > DEFERRED_BUDGET_MAX)
+            budget = DEFERRED_BUDGET_MAX;
+    }
+
+    //列表中的条目（取消时从收件箱移过去的）比收件箱中的早，先执行；收件箱中的条目直接取出执行，不经过列表
+    for (;;) {
+        deferred_cb_fn fn;
+        void *arg;
+
+        if ((cb = TAILQ_FIRST(&queue->deferred_cb_list)) != NULL)
+            TAILQ_REMOVE(&queue->deferred_cb_list, cb, cb_next);
+        else if ((cb = event_deferred_cb_inbox_pop(queue)) == NULL)
+            break;
+        fn = cb->cb;
+        arg = cb->arg;
+        if (queue->record_wait) {
+            int64_t wait = (int64_t)event_stats_now_ns(base) - cb->queued_ns;
+            event_stats_record(&base->stats.deferred_wait_ns, wait > 0 ? (uint64_t)wait : 0);
+        }
+        ++removed;
+        //从这里开始其它线程可以重新调度cb；下面的解锁是完整的内存屏障，fn看得到调度前写入的数据
+        __atomic_store_n(&cb->queued, DEFERRED_CB_IDLE, __ATOMIC_RELEASE);
+        event_slow_cb_start(base, &watch);
         UNLOCK_DEFERRED_QUEUE(queue);
 
-        cb->cb(cb, cb->arg);
+        fn(cb, arg);
 
+        event_slow_cb_finish(base, &watch, (void *)fn, arg, -1, 0, 1);
         LOCK_DEFERRED_QUEUE(queue);
-        if (*breakptr)
-            return -1;
-        if (++count == MAX_DEFERRED)
+        if (*breakptr) {
+            broken = 1;
+            break;
+        }
+        if (removed == budget)
             break;
     }
-#undef MAX_DEFERRED
-    return count;
+    //执行过的条目一次性从计数中减去，期间计数偏大只会让事件循环多检查一次
+    if (removed)
+        __atomic_sub_fetch(&queue->active_count, removed, __ATOMIC_RELAXED);
+    return broken ? -1 : removed;
 }
 
 //告诉当前正在运行event_loop的线程（如果有的话）需要在其dispatch()中停止等待（如果有），并处理所有活动事件和延迟回调（如果有的话）。
@@ -440,18 +636,133 @@ static int evthread_notify_base(struct event_base *base)
     EVENT_BASE_ASSERT_LOCKED(base);
     if (!base->th_notify_fn)
         return -1;
+    if (base->in_batch) {
+        base->batch_notify = 1;
+        return 0;
+    }
     if (base->is_notify_pending)
         return 0;
     base->is_notify_pending = 1;
     return base->th_notify_fn(base);
 }
 
-/** 延迟回调函数队列：唤醒event_base. */
-static void notify_base_cbq_callback(struct deferred_cb_queue *cb, void *baseptr)
+static void event_post_queue_init(struct event_post_queue *q)
+{
+    q->stub.next = NULL;
+    q->head = &q->stub;
+    q->tail = &q->stub;
+    q->notify_pending = 0;
+}
+
+static void event_post_queue_push(struct event_post_queue *q, struct event_post_node *n)
+{
+    struct event_post_node *prev;
+
+    n->next = NULL;
+    prev = __atomic_exchange_n(&q->head, n, __ATOMIC_ACQ_REL);
+    //在下面这一步完成之前，消费者看到的链表是断开的，会当作空队列，由本次投递的唤醒保证稍后再取
+    __atomic_store_n(&prev->next, n, __ATOMIC_RELEASE);
+}
+
+//取出一个节点，队列为空或者生产者正在入队时返回NULL，只能在事件循环线程中调用
+static struct event_post_node *event_post_queue_pop(struct event_post_queue *q)
+{
+    struct event_post_node *tail = q->tail;
+    struct event_post_node *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+    if (tail == &q->stub) {
+        if (next == NULL)
+            return NULL;
+        q->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    //tail是最后一个节点，把stub放回队尾后才能取出它
+    event_post_queue_push(q, &q->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+static int event_post_queue_empty(struct event_post_queue *q)
+{
+    return q->tail == &q->stub && __atomic_load_n(&q->stub.next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+//释放没有执行的任务
+static void event_post_queue_clear(struct event_post_queue *q)
+{
+    struct event_post_node *n;
+    while ((n = event_post_queue_pop(q)) != NULL)
+        mm_free(n);
+}
+
+int event_base_post(struct event_base *base, void (*fn)(void *), void *arg)
+{
+    struct event_post_node *n;
+
+    if (base == NULL || fn == NULL)
+        return -1;
+    if ((n = (struct event_post_node *)mm_malloc(sizeof(struct event_post_node))) == NULL) {
+        event_warn("%s: malloc", __func__);
+        return -1;
+    }
+    n->fn = fn;
+    n->arg = arg;
+    event_post_queue_push(&base->post_queue, n);
+
+    //两次dispatch之间的多次投递只唤醒一次；通知函数只写管道，不需要持有锁
+    if (!__atomic_exchange_n(&base->post_queue.notify_pending, 1, __ATOMIC_ACQ_REL) && base->th_notify_fn)
+        base->th_notify_fn(base);
+    return 0;
+}
+
+/*
+ * 执行本轮开始时已经投递的任务，之后投递的任务留到下一轮，避免生产者持续投递时饿死其它事件
+ * 开始时需要持有锁，执行每个任务时释放锁
+ */
+static int event_process_posted(struct event_base *base)
+{
+    struct event_post_queue *q = &base->post_queue;
+    struct event_post_node *last, *n;
+    int count = 0;
+
+    //先清除标志再取任务：之后完成入队的生产者会重新唤醒事件循环
+    __atomic_store_n(&q->notify_pending, 0, __ATOMIC_SEQ_CST);
+    last = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    while ((n = event_post_queue_pop(q)) != NULL) {
+        EVBASE_RELEASE_LOCK(base, th_base_lock);
+        n->fn(n->arg);
+        EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+        ++count;
+        if (n == last) {
+            mm_free(n);
+            break;
+        }
+        mm_free(n);
+        if (base->event_break)
+            break;
+    }
+    return count;
+}
+
+/** 延迟回调函数队列：唤醒event_base，调用时不持有锁；两次取出之间只唤醒一次，通知函数只写管道 */
+static void notify_base_cbq_callback(struct deferred_cb_queue *queue, void *baseptr)
 {
     struct event_base *base = (struct event_base*)baseptr;
-    if (EVBASE_NEED_NOTIFY(base))
-        evthread_notify_base(base);
+    if (EVBASE_NEED_NOTIFY(base) && base->th_notify_fn &&
+        !__atomic_exchange_n(&queue->inbox_notify_pending, 1, __ATOMIC_ACQ_REL))
+        base->th_notify_fn(base);
 }
 
 
@@ -474,42 +785,105 @@ void event_deferred_cb_init(struct deferred_cb *cb,deferred_cb_fn fn,void *arg)
     cb->arg = arg;
 }
 
+//放入收件箱，任何线程都可以调用
+static void event_deferred_cb_inbox_push(struct deferred_cb_queue *queue, struct deferred_cb *cb)
+{
+    struct deferred_cb *prev;
+
+    cb->inbox_next = NULL;
+    prev = __atomic_exchange_n(&queue->inbox_head, cb, __ATOMIC_ACQ_REL);
+    //在下面这一步完成之前，消费者看到的链表是断开的，会当作空收件箱，由本次调度的唤醒保证稍后再取
+    __atomic_store_n(&prev->inbox_next, cb, __ATOMIC_RELEASE);
+}
+
+//从收件箱取出一个条目，为空或者生产者正在入队时返回NULL，需要持有队列锁
+static struct deferred_cb *event_deferred_cb_inbox_pop(struct deferred_cb_queue *queue)
+{
+    struct deferred_cb *tail = queue->inbox_tail;
+    struct deferred_cb *next = __atomic_load_n(&tail->inbox_next, __ATOMIC_ACQUIRE);
+
+    if (tail == &queue->inbox_stub) {
+        if (next == NULL)
+            return NULL;
+        queue->inbox_tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->inbox_next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        queue->inbox_tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&queue->inbox_head, __ATOMIC_ACQUIRE))
+        return NULL;
+    event_deferred_cb_inbox_push(queue, &queue->inbox_stub);
+    next = __atomic_load_n(&tail->inbox_next, __ATOMIC_ACQUIRE);
+    if (next) {
+        queue->inbox_tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+void event_deferred_cb_queue_drain(struct deferred_cb_queue *queue)
+{
+    struct deferred_cb *cb;
+
+    //先清除标志再取条目：之后完成入队的生产者会重新唤醒事件循环
+    __atomic_store_n(&queue->inbox_notify_pending, 0, __ATOMIC_SEQ_CST);
+    while ((cb = event_deferred_cb_inbox_pop(queue)) != NULL) {
+        __atomic_store_n(&cb->queued, DEFERRED_CB_LISTED, __ATOMIC_RELEASE);
+        TAILQ_INSERT_TAIL(&queue->deferred_cb_list, cb, cb_next);
+    }
+}
+
 void event_deferred_cb_cancel(struct deferred_cb_queue *queue,struct deferred_cb *cb)
 {
     if(!queue){
         if(current_base)queue = &current_base->defer_queue;
         else return ;
     }
+    if (__atomic_load_n(&cb->queued, __ATOMIC_ACQUIRE) == DEFERRED_CB_IDLE)
+        return;
     LOCK_DEFERRED_QUEUE(queue);
-    if(cb->queued){
+    //返回后队列不能再引用cb：还在收件箱中时先取出到列表；生产者交换了head但还没有链接上时取不出，等它完成
+    while (__atomic_load_n(&cb->queued, __ATOMIC_ACQUIRE) == DEFERRED_CB_INBOX) {
+        event_deferred_cb_queue_drain(queue);
+        if (__atomic_load_n(&cb->queued, __ATOMIC_ACQUIRE) == DEFERRED_CB_INBOX)
+            sched_yield();
+    }
+    if(__atomic_load_n(&cb->queued, __ATOMIC_RELAXED) == DEFERRED_CB_LISTED){
         TAILQ_REMOVE(&queue->deferred_cb_list,cb,cb_next);
-        --queue->active_count;
-        cb->queued = 0;
+        __atomic_sub_fetch(&queue->active_count, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&cb->queued, DEFERRED_CB_IDLE, __ATOMIC_RELEASE);
     }
     UNLOCK_DEFERRED_QUEUE(queue);
 }
 
 void event_deferred_cb_schedule(struct deferred_cb_queue *queue,struct deferred_cb *cb)
 {
+    int expected = DEFERRED_CB_IDLE;
+
     if(!queue){
         if(current_base)queue = &current_base->defer_queue;
         else return;
     }
-    LOCK_DEFERRED_QUEUE(queue);
-    if(!cb->queued){
-        cb->queued = 1;
-        TAILQ_INSERT_TAIL(&queue->deferred_cb_list,cb,cb_next);
-        ++queue->active_count;
-        if(queue->notify_fn)
-            queue->notify_fn(queue,queue->notify_arg);
-    }
-    UNLOCK_DEFERRED_QUEUE(queue);
+    //不加锁：只有把cb从空闲改为在收件箱中的线程负责入队，已经在队列中时什么都不做
+    if (!__atomic_compare_exchange_n(&cb->queued, &expected, DEFERRED_CB_INBOX, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return;
+    if (queue->record_wait)
+        cb->queued_ns = evclock_now_ns(queue->clock_source);
+    __atomic_add_fetch(&queue->active_count, 1, __ATOMIC_RELAXED);
+    event_deferred_cb_inbox_push(queue, cb);
+    if(queue->notify_fn)
+        queue->notify_fn(queue,queue->notify_arg);
 }
 
 void event_deferred_cb_queue_init(struct deferred_cb_queue *cb)
 {
     memset(cb, 0, sizeof(struct deferred_cb_queue));
     TAILQ_INIT(&cb->deferred_cb_list);
+    cb->inbox_head = &cb->inbox_stub;
+    cb->inbox_tail = &cb->inbox_stub;
 }
 
 struct deferred_cb_queue *event_base_get_deferred_cb_queue(struct event_base *base)
@@ -567,6 +941,10 @@ void event_base_free(struct event_base *base)
         event_del(ev);
         ++n_deleted;
     }
+    while (base->timewheel && (ev = timer_wheel_first(base->timewheel)) != NULL) {
+        event_del(ev);
+        ++n_deleted;
+    }
     //删除公共超时时间队列元素
     for (int i = 0; i < base->n_common_timeouts; ++i) {
         struct common_timeout_list *ctl = base->common_timeout_queues[i];
@@ -604,19 +982,34 @@ void event_base_free(struct event_base *base)
     //释放IO复用
     if(base->evsel != NULL && base->evsel->dealloc != NULL)
         base->evsel->dealloc(base);
-;
+    event_changelist_freemem(&base->changelist);
+
     for(int i = 0; i < base->nactivequeues;++i)
         EVUTIL_ASSERT(TAILQ_EMPTY(&base->activequeues[i]));
 
     EVUTIL_ASSERT(min_heap_empty_(&base->timeheap));
     min_heap_dtor_(&base->timeheap);
+    if (base->timewheel) {
+        EVUTIL_ASSERT(timer_wheel_empty(base->timewheel));
+        timer_wheel_free(base->timewheel);
+    }
 
     mm_free(base->activequeues);
+    if (base->nactive_per_pri)
+        mm_free(base->nactive_per_pri);
+    if (base->priority_budgets)
+        mm_free(base->priority_budgets);
     EVUTIL_ASSERT(TAILQ_EMPTY(&base->eventqueue));
 
+    //没有执行的投递任务直接丢弃
+    event_post_queue_clear(&base->post_queue);
+
     evmap_io_clear(&base->io);
     evmap_signal_clear(&base->sigmap);
 
+    for (int i = 0; i < EVENT_POOL_N; ++i)
+        mm_pool_clear(&base->pools[i]);
+
     EVTHREAD_FREE_LOCK(base->th_base_lock,EVTHREAD_LOCKTYPE_RECURSIVE);
     EVTHREAD_FREE_COND(base->current_event_cond);
 
@@ -638,8 +1031,12 @@ int event_base_priority_init(struct event_base *base,int npriorities){
 
     if(base->nactivequeues){
         mm_free(base->activequeues);
+        mm_free(base->nactive_per_pri);
+        base->nactive_per_pri = NULL;
         base->nactivequeues = 0;
     }
+    //没有激活事件，所有队列都是空的
+    memset(base->active_bitmap, 0, sizeof(base->active_bitmap));
 
     /* Allocate our priority queues */
     base->activequeues = (struct event_list *)mm_calloc(npriorities, sizeof(struct event_list));
@@ -647,11 +1044,34 @@ int event_base_priority_init(struct event_base *base,int npriorities){
         event_warn("%s:calloc",__func__);
         goto err;
     }
+    base->nactive_per_pri = (int *)mm_calloc(npriorities, sizeof(int));
+    if(base->nactive_per_pri == NULL){
+        event_warn("%s:calloc",__func__);
+        mm_free(base->activequeues);
+        base->activequeues = NULL;
+        goto err;
+    }
     base->nactivequeues = npriorities;
 
     for (int i = 0; i < base->nactivequeues; ++i) {
         TAILQ_INIT(&base->activequeues[i]);
     }
+
+    //已设置的预算跟随优先级数目调整，新增的优先级不限制
+    if (base->priority_budgets) {
+        int *budgets = (int *)mm_realloc(base->priority_budgets, npriorities * sizeof(int));
+        if (budgets == NULL) {
+            event_warn("%s:realloc",__func__);
+            mm_free(base->priority_budgets);
+            base->priority_budgets = NULL;
+            base->npriority_budgets = 0;
+            goto err;
+        }
+        for (int i = base->npriority_budgets; i < npriorities; ++i)
+            budgets[i] = 0;
+        base->priority_budgets = budgets;
+        base->npriority_budgets = npriorities;
+    }
 ok:
     r = 0;
 err:
@@ -659,6 +1079,63 @@ err:
     return r;
 }
 
+int event_base_set_priority_budget(struct event_base *base, int pri, int budget)
+{
+    int r = -1;
+
+    if (base == NULL || budget < 0)
+        return -1;
+
+    EVBASE_ACQUIRE_LOCK(base,th_base_lock);
+    if (pri < 0 || pri >= base->nactivequeues)
+        goto err;
+    if (base->priority_budgets == NULL) {
+        base->priority_budgets = (int *)mm_calloc(base->nactivequeues, sizeof(int));
+        if (base->priority_budgets == NULL) {
+            event_warn("%s:calloc",__func__);
+            goto err;
+        }
+        base->npriority_budgets = base->nactivequeues;
+    }
+    base->priority_budgets[pri] = budget;
+    r = 0;
+err:
+    EVBASE_RELEASE_LOCK(base,th_base_lock);
+    return r;
+}
+
+enum event_clock_source event_base_get_clock(const struct event_base *base)
+{
+    return (enum event_clock_source)base->clock_source;
+}
+
+int event_base_get_busy_poll(const struct event_base *base)
+{
+    if (base->busy_poll.tv_sec > INT_MAX / 1000000 - 1)
+        return INT_MAX;
+    return (int)(base->busy_poll.tv_sec * 1000000 + base->busy_poll.tv_usec);
+}
+
+int event_base_get_stats(struct event_base *base, struct event_base_stats *stats)
+{
+    if (base == NULL || stats == NULL)
+        return -1;
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    *stats = base->stats;
+    stats->deferred_depth = __atomic_load_n(&base->defer_queue.active_count, __ATOMIC_RELAXED);
+    if (base->defer_queue.record_wait) {
+        struct deferred_cb *cb;
+        //列表中的条目都比收件箱中的早，队首就是最早调度的
+        event_deferred_cb_queue_drain(&base->defer_queue);
+        if ((cb = TAILQ_FIRST(&base->defer_queue.deferred_cb_list)) != NULL) {
+            int64_t wait = (int64_t)event_stats_now_ns(base) - cb->queued_ns;
+            stats->deferred_oldest_wait_ns = wait > 0 ? (uint64_t)wait : 0;
+        }
+    }
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+    return 0;
+}
+
 int event_base_get_npriorities(struct event_base *base){
     int n;
     if(base == NULL)
@@ -671,6 +1148,20 @@ int event_base_get_npriorities(struct event_base *base){
     return n;
 }
 
+int event_base_get_num_active(struct event_base *base, int pri)
+{
+    int n = -1;
+    if (base == NULL)
+        base = current_base;
+
+    EVBASE_ACQUIRE_LOCK(base,th_base_lock);
+    if (pri >= 0 && pri < base->nactivequeues)
+        n = base->nactive_per_pri[pri];
+    EVBASE_RELEASE_LOCK(base,th_base_lock);
+
+    return n;
+}
+
 const char *event_base_get_method(const struct event_base *base)
 {
     EVUTIL_ASSERT(base);
@@ -731,12 +1222,35 @@ int event_base_loopbreak(struct event_base *base){
     return r;
 }
 
+void *event_base_pool_get_(struct event_base *base, int kind, size_t size)
+{
+    void *p;
+
+    if (!event_base_pool_enabled_(base))
+        return mm_malloc(size);
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    p = mm_pool_get(&base->pools[kind], size);
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+    return p;
+}
+
+void event_base_pool_put_(struct event_base *base, int kind, void *p, size_t size)
+{
+    if (!event_base_pool_enabled_(base)) {
+        mm_free(p);
+        return;
+    }
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    mm_pool_put(&base->pools[kind], p, size);
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+
 //一次性时间的回调函数：唤醒用户回调，释放内存
 static void event_once_cb(int fd,short events,void *arg){
     struct event_once *eonce= (struct event_once*)arg;
     (*eonce->cb)(fd,events,eonce->arg);
     event_debug_unassign(&eonce->ev);
-    mm_free(eonce);
+    event_base_pool_put_(eonce->ev.ev_base, EVENT_POOL_EVENT_ONCE, eonce, sizeof(struct event_once));
 }
 
 int event_base_once(struct event_base *base,int fd, short events,
@@ -749,8 +1263,9 @@ int event_base_once(struct event_base *base,int fd, short events,
     if(events &(EV_SIGNAL | EV_PERSIST))
         return -1;
 
-    if((eonce = (struct event_once *)mm_calloc(1,sizeof(struct event_once))) == NULL)
+    if((eonce = (struct event_once *)event_base_pool_get_(base, EVENT_POOL_EVENT_ONCE, sizeof(struct event_once))) == NULL)
         return -1;
+    memset(eonce, 0, sizeof(struct event_once));
     eonce->arg = arg;
     eonce->cb = callback;
 
@@ -766,19 +1281,38 @@ int event_base_once(struct event_base *base,int fd, short events,
         event_assign(&eonce->ev,base,fd,events,event_once_cb,eonce);
     }
     else{
-        mm_free(eonce);
+        event_base_pool_put_(base, EVENT_POOL_EVENT_ONCE, eonce, sizeof(struct event_once));
         return -1;
     }
 
     if (res == 0)
         res = event_add(&eonce->ev, tv);
     if (res != 0) {
-        mm_free(eonce);
+        event_base_pool_put_(base, EVENT_POOL_EVENT_ONCE, eonce, sizeof(struct event_once));
         return (res);
     }
     return 0;
 }
 
+//返回不小于pri的第一个非空活动事件队列的优先级，没有时返回-1
+static inline int event_base_next_active_pri(const struct event_base *base, int pri)
+{
+    const int nwords = (int)(sizeof(base->active_bitmap) / sizeof(base->active_bitmap[0]));
+    int w = pri >> 6;
+    uint64_t bits;
+
+    if (pri >= base->nactivequeues)
+        return -1;
+    bits = base->active_bitmap[w] & (~(uint64_t)0 << (pri & 63));
+    for (;;) {
+        if (bits)
+            return (w << 6) + __builtin_ctzll(bits);
+        if (++w >= nwords)
+            return -1;
+        bits = base->active_bitmap[w];
+    }
+}
+
 /*
  * 激活事件存储于激活事件队列（带优先级的队列），priority值越小优先级越高。
  * 按照优先级大小遍历，处理激活事件链表中的所有就绪事件；
@@ -787,22 +1321,37 @@ int event_base_once(struct event_base *base,int fd, short events,
 static int event_process_active(struct event_base *base)
 {
     struct event_list *activeq = NULL;
-    int  c = 0;
-
-    for (int i = 0; i < base->nactivequeues; ++i) {
-        if (TAILQ_FIRST(&base->activequeues[i]) != NULL) {
-            base->event_running_priority = i;//按照优先级大小遍历，设置base当前运行的优先级
-            activeq = &base->activequeues[i];
-            //在特定的优先级的队列中处理激活事件(一个优先级包含一个激活事件队列)
-            c = event_process_active_single_queue(base, activeq);
-            if (c < 0) {
-                goto done;
-            } else if (c > 0)//处理真实事件,不要考虑较低优先级的事,如果c==0，我们处理的所有事件都是内部的, 继续。
-                break;
+    int  c = 0, total = 0, n_deferred;
+    int limit = base->max_dispatch_callbacks;
+
+    //通过位图直接跳到下一个非空队列，不用逐个检查空队列
+    for (int i = event_base_next_active_pri(base, 0); i >= 0 && total < limit; i = event_base_next_active_pri(base, i + 1)) {
+        int max_to_process = limit - total;
+        if (base->priority_budgets && base->priority_budgets[i] > 0 && base->priority_budgets[i] < max_to_process)
+            max_to_process = base->priority_budgets[i];
+
+        base->event_running_priority = i;//按照优先级大小遍历，设置base当前运行的优先级
+        activeq = &base->activequeues[i];
+        //在特定的优先级的队列中处理激活事件(一个优先级包含一个激活事件队列)
+        c = event_process_active_single_queue(base, activeq, max_to_process);
+        if (c < 0) {
+            goto done;
         }
+        total += c;
+        //处理真实事件,不要考虑较低优先级的事,如果c==0，我们处理的所有事件都是内部的, 继续。
+        //设置了优先级预算时，轮询所有优先级
+        if (c > 0 && !base->priority_budgets)
+            break;
+        if (base->event_continue)
+            break;
     }
+    c = total;
 
-    event_process_deferred_callbacks(&base->defer_queue,&base->event_break);
+    n_deferred = event_process_deferred_callbacks(base, &base->defer_queue,&base->event_break);
+    if (EVENT_BASE_COLLECT_STATS(base)) {
+        event_stats_record(&base->stats.callbacks_per_iteration, total);
+        event_stats_record(&base->stats.deferred_per_iteration, n_deferred > 0 ? n_deferred : 0);
+    }
 
 done:
     base->event_running_priority = -1;
@@ -810,15 +1359,57 @@ done:
     return c;
 }
 
+/*
+ * 忙轮询：以超时为0调用dispatch，直到发现需要处理的事件、自旋时间用完或者到达*tv_p
+ * 发现事件或者已经到达*tv_p返回1，不需要再阻塞；自旋时间用完返回0，*tv_p减去已经自旋的时间；出错返回-1
+ */
+static int event_base_busy_poll(struct event_base *base, struct timeval *tv_p)
+{
+    struct timeval zero;
+    int64_t start, now, elapsed = 0, budget = timeval_to_ns(&base->busy_poll);
+    int64_t limit = tv_p ? timeval_to_ns(tv_p) : INT64_MAX;
+    //粗粒度时钟一个jiffy内不变，自旋时间用精确时钟计量
+    int clock = evclock_precise_source(base->clock_source);
+
+    evutil_timerclear(&zero);
+    if (limit < budget)
+        budget = limit;
+
+    start = evclock_now_ns(clock);
+    for (;;) {
+        if (EVSEL_DISPATCH(base, &zero) == -1)
+            return -1;
+        ++base->stats.busy_poll_spins;
+        if (N_ACTIVE_CALLBACKS(base) || !event_post_queue_empty(&base->post_queue) ||
+            base->event_break || base->event_gotterm) {
+            ++base->stats.busy_poll_hits;
+            return 1;
+        }
+        now = evclock_now_ns(clock);
+        elapsed = now - start;
+        if (elapsed >= budget)
+            break;
+    }
+
+    if (tv_p) {
+        if (elapsed >= limit)
+            return 1;//下一个定时器已经到期
+        ns_to_timeval(limit - elapsed, tv_p);
+    }
+    ++base->stats.busy_poll_sleeps;
+    return 0;
+}
+
 int event_base_dispatch(struct event_base *event_base)
 {
     return (event_base_loop(event_base, 0));
 }
 
 int event_base_loop(struct event_base *base, int flags){
-    const struct eventop *evsel = base->evsel;
     struct timeval tv,*tv_p;
     int res,done,retval = 0;
+    uint64_t stats_start = 0;
+    int stats_nactive = 0;
 
     EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 
@@ -849,7 +1440,7 @@ int event_base_loop(struct event_base *base, int flags){
 
         // 根据timer heap中事件的最小超时时间，计算系统I/O demultiplexer的最大等待时间
         tv_p = &tv;
-        if(!N_ACTIVE_CALLBACKS(base) && !(flags &EVLOOP_NONBLOCK)){
+        if(!N_ACTIVE_CALLBACKS(base) && event_post_queue_empty(&base->post_queue) && !(flags &EVLOOP_NONBLOCK)){
             timeout_next(base,&tv_p);
         }
         else{
@@ -858,7 +1449,8 @@ int event_base_loop(struct event_base *base, int flags){
         }
 
         //没有注册事件,直接退出
-        if (!event_haveevents(base) && !N_ACTIVE_CALLBACKS(base)) {
+        if (!(flags & EVLOOP_NO_EXIT_ON_EMPTY) && !event_haveevents(base) && !N_ACTIVE_CALLBACKS(base) &&
+            event_post_queue_empty(&base->post_queue)) {
             event_debug(("%s: no events registered.", __func__));
             retval = 1;
             goto done;
@@ -868,7 +1460,28 @@ int event_base_loop(struct event_base *base, int flags){
         gettime(base,&base->event_tv);
         clear_time_cache(base);
 
-        res = evsel->dispatch(base, tv_p);
+        ++base->stats.loop_iterations;
+        //统计时复用上一阶段结束时读取的时钟，每轮最多读两次时钟
+        if (EVENT_BASE_COLLECT_STATS(base)) {
+            if (!stats_start)
+                stats_start = event_stats_now_ns(base);
+            stats_nactive = base->event_count_active;
+        }
+        //需要阻塞时先忙轮询一段时间
+        res = 0;
+        if (evutil_timerisset(&base->busy_poll) && (tv_p == NULL || evutil_timerisset(tv_p)))
+            res = event_base_busy_poll(base, tv_p);
+        if (res == 0)
+            res = EVSEL_DISPATCH(base, tv_p);
+        else if (res == 1)
+            res = 0;
+        if (EVENT_BASE_COLLECT_STATS(base)) {
+            uint64_t t = event_stats_now_ns(base);
+            event_stats_record(&base->stats.dispatch_wait_ns, t - stats_start);
+            stats_start = t;
+            event_stats_record(&base->stats.events_per_dispatch,
+                               base->event_count_active > stats_nactive ? base->event_count_active - stats_nactive : 0);
+        }
 
         if (res == -1) {
             event_debug(("%s: dispatch returned unsuccessfully.", __func__));
@@ -881,11 +1494,23 @@ int event_base_loop(struct event_base *base, int flags){
         //检查heap中的timer events，将就绪的timer event从heap上删除，并插入到激活链表中
         timeout_process(base);
 
+        //执行其它线程投递的任务
+        if (!event_post_queue_empty(&base->post_queue)) {
+            int n = event_process_posted(base);
+            if ((flags & EVLOOP_ONCE) && n > 0 && !N_ACTIVE_CALLBACKS(base))
+                done = 1;
+        }
+
         //存在激活事件
         // 寻找最高优先级（priority值越小优先级越高）的激活事件链表，然后处理链表中的所有就绪事件；
         // 因此低优先级的就绪事件可能得不到及时处理
         if (N_ACTIVE_CALLBACKS(base)) {
             int n = event_process_active(base);// 处理激活链表中的就绪event，调用其回调函数执行事件处理
+            if (EVENT_BASE_COLLECT_STATS(base)) {
+                uint64_t t = event_stats_now_ns(base);
+                event_stats_record(&base->stats.process_active_ns, t - stats_start);
+                stats_start = t;
+            }
             if ((flags & EVLOOP_ONCE) && N_ACTIVE_CALLBACKS(base) == 0 && n != 0)
                 done = 1;
         }
@@ -925,11 +1550,13 @@ int event_base_gettimeofday_cached(struct event_base *base, struct timeval *tv)
     }
 
     EVBASE_ACQUIRE_LOCK(base, th_base_lock);
-    if (base->tv_cache.tv_sec == 0) {
+    if (base->time_cache_ns == 0) {
         r = gettimeofday(tv, NULL);
     }
     else {
-        evutil_timeradd(&base->tv_cache, &base->tv_clock_diff, tv);
+        struct timeval cache;
+        ns_to_timeval(base->time_cache_ns, &cache);
+        evutil_timeradd(&cache, &base->tv_clock_diff, tv);
         r = 0;
     }
     EVBASE_RELEASE_LOCK(base, th_base_lock);
@@ -941,17 +1568,20 @@ int event_base_gettimeofday_cached(struct event_base *base, struct timeval *tv)
 static void common_timeout_callback(int fd, short what, void *arg)
 {
     struct timeval now;
+    int64_t now_ns;
     struct common_timeout_list *ctl = (struct common_timeout_list *)arg;
     struct event_base *base = ctl->base;
     struct event *ev = NULL;
     EVBASE_ACQUIRE_LOCK(base, th_base_lock);
-    gettime(base, &now);
+    gettime_ns(base, &now_ns);
+    ns_to_timeval(now_ns, &now);
     while (1) {
         ev = TAILQ_FIRST(&ctl->events);
         if (!ev || ev->ev_timeout.tv_sec > now.tv_sec ||
             (ev->ev_timeout.tv_sec == now.tv_sec &&
              (ev->ev_timeout.tv_usec&MICROSECONDS_MASK) > now.tv_usec))
             break;
+        event_stats_record_timer(base, ev, now_ns);
         event_del_nolock(ev);
         event_active_nolock(ev, EV_TIMEOUT, 1);
     }
@@ -1108,19 +1738,37 @@ struct event_base *event_base_new_with_config(const struct event_config *cfg){
 
     if(cfg)
         base->flags = cfg->flags;
+    base->max_dispatch_callbacks = (cfg && cfg->max_dispatch_callbacks > 0) ? cfg->max_dispatch_callbacks : INT_MAX;
+    if (cfg)
+        base->busy_poll = cfg->busy_poll;
+    for (int i = 0; i < EVENT_POOL_N; ++i)
+        base->pools[i].max_free = cfg ? cfg->object_pool_max : 0;
 
     //是否应该检查环境变量,设置时间相关的参数
     should_check_environment = !(cfg && (cfg->flags & EVENT_BASE_FLAG_IGNORE_ENV));
 
-    //判断是否使用monotonic
-    detect_monotonic();
+    //选择时钟源，TSC不可用时退回CLOCK_MONOTONIC
+    base->clock_source = cfg ? cfg->clock_source : EVENT_CLOCK_MONOTONIC;
+    if (base->clock_source == EVENT_CLOCK_TSC && evclock_tsc_init() < 0) {
+        event_warnx("%s: no invariant TSC, using CLOCK_MONOTONIC", __func__);
+        base->clock_source = EVENT_CLOCK_MONOTONIC;
+    }
     gettime(base,&base->event_tv);
 
     //初始化定时器小根堆
     min_heap_ctor_(&base->timeheap);
+    if (cfg && cfg->use_timer_wheel) {
+        base->timewheel = timer_wheel_new(&cfg->timer_wheel_tick, &base->event_tv);
+        if (base->timewheel == NULL) {
+            event_warnx("%s: Unable to create timer wheel.", __func__);
+            mm_free(base);
+            return NULL;
+        }
+    }
 
     base->sig.ev_signal_pair[0] = -1;
     base->sig.ev_signal_pair[1] = -1;
+    sigemptyset(&base->sig.signalfd_blocked);
     base->th_notify_fd[0] = -1;
     base->th_notify_fd[1] = -1;
 
@@ -1129,9 +1777,14 @@ struct event_base *event_base_new_with_config(const struct event_config *cfg){
     event_deferred_cb_queue_init(&base->defer_queue);
     base->defer_queue.notify_fn = notify_base_cbq_callback;
     base->defer_queue.notify_arg = base;
+    base->defer_queue.max_per_iteration = cfg ? cfg->max_deferred_callbacks : 0;
+    base->defer_queue.record_wait = EVENT_BASE_COLLECT_STATS(base) != 0;
+    base->defer_queue.clock_source = evclock_precise_source(base->clock_source);
 
     evmap_io_initmap(&base->io);
     evmap_signal_initmap(&base->sigmap);
+    event_changelist_init(&base->changelist);
+    event_post_queue_init(&base->post_queue);
 
     base->evbase = NULL;
     for (int i = 0; eventops[i] && !base->evbase ; ++i) {
@@ -1196,6 +1849,71 @@ int event_config_set_num_cpus_hint(struct event_config *cfg, int cpus)
     return (0);
 }
 
+int event_config_set_timer_wheel(struct event_config *cfg, const struct timeval *tick)
+{
+    if (!cfg)
+        return (-1);
+    if (tick == NULL) {
+        cfg->timer_wheel_tick.tv_sec = 0;
+        cfg->timer_wheel_tick.tv_usec = 1000;
+    } else {
+        if (tick->tv_sec < 0 || tick->tv_usec < 0 || tick->tv_usec >= 1000000 || (!tick->tv_sec && !tick->tv_usec))
+            return (-1);
+        cfg->timer_wheel_tick = *tick;
+    }
+    cfg->use_timer_wheel = 1;
+    return (0);
+}
+
+int event_config_set_max_dispatch_callbacks(struct event_config *cfg, int max_callbacks)
+{
+    if (!cfg)
+        return (-1);
+    cfg->max_dispatch_callbacks = max_callbacks > 0 ? max_callbacks : 0;
+    return (0);
+}
+
+int event_config_set_max_deferred_callbacks(struct event_config *cfg, int max_callbacks)
+{
+    if (!cfg)
+        return (-1);
+    cfg->max_deferred_callbacks = max_callbacks > 0 ? max_callbacks : 0;
+    return (0);
+}
+
+int event_config_set_busy_poll(struct event_config *cfg, const struct timeval *spin)
+{
+    if (!cfg)
+        return (-1);
+    if (spin == NULL) {
+        cfg->busy_poll.tv_sec = 0;
+        cfg->busy_poll.tv_usec = 50;
+    } else {
+        if (spin->tv_sec < 0 || spin->tv_usec < 0 || spin->tv_usec >= 1000000)
+            return (-1);
+        cfg->busy_poll = *spin;
+    }
+    return (0);
+}
+
+int event_config_set_object_pool(struct event_config *cfg, int max_cached)
+{
+    if (!cfg)
+        return (-1);
+    cfg->object_pool_max = max_cached > 0 ? max_cached : 0;
+    return (0);
+}
+
+int event_config_set_clock(struct event_config *cfg, enum event_clock_source clock)
+{
+    if (!cfg)
+        return (-1);
+    if (clock != EVENT_CLOCK_MONOTONIC && clock != EVENT_CLOCK_MONOTONIC_COARSE && clock != EVENT_CLOCK_TSC)
+        return (-1);
+    cfg->clock_source = clock;
+    return (0);
+}
+
 int event_config_set_flag(struct event_config *cfg, int flag)
 {
     if (!cfg)
@@ -1224,11 +1942,13 @@ int event_config_avoid_method(struct event_config *cfg, const char *method)
 struct event *event_new(struct event_base *base, int fd, short events, void (*cb)(int, short, void *), void *arg)
 {
     struct event *ev;
-    ev = (struct event *)mm_malloc(sizeof(struct event));
+    if (!base)
+        base = current_base;
+    ev = (struct event *)event_base_pool_get_(base, EVENT_POOL_EVENT, sizeof(struct event));
     if (ev == NULL)
         return (NULL);
     if (event_assign(ev, base, fd, events, cb, arg) < 0) {
-        mm_free(ev);
+        event_base_pool_put_(base, EVENT_POOL_EVENT, ev, sizeof(struct event));
         return (NULL);
     }
 
@@ -1319,13 +2039,16 @@ int event_add_nolock(struct event *ev, const struct timeval *tv, int tv_is_absol
      * 如果tv不为NULL，并且事件不在小根堆中，判断小根堆中分配的内存是否有多余空间，空间不足，倍增法分配空间，分配失败返回-1
      * 如果任何一个步骤错误，不改变任何状态
      */
-    if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT)) {
+    if (tv != NULL && !(ev->ev_flags & EVLIST_TIMEOUT) && !base->timewheel) {
         if (min_heap_reserve_(&base->timeheap, 1 + min_heap_size_(&base->timeheap)) == -1)
             return (-1);  /* ENOMEM == errno */
     }
 
     /* 如果主线程正在执行一个信号事件的回调函数，我们当前不在主线程中，我们需要等待直到回调函数执行完成 */
     if(base->current_event == ev && (ev->ev_events & EV_SIGNAL) && !EVBASE_IN_THREAD(base)){
+        //等待时会释放锁，先结束批量操作，让主线程看到完整的堆
+        if (base->in_batch)
+            event_base_batch_end(base);
         ++base->current_event_waiters;
         EVTHREAD_COND_WAIT(base->current_event_cond, base->th_base_lock);
     }
@@ -1356,7 +2079,7 @@ int event_add_nolock(struct event *ev, const struct timeval *tv, int tv_is_absol
 
         //如果事件已经插入到小根堆中，并且小根堆的节点数不等于0，需要通知主线程，移除事件ev
         if (ev->ev_flags & EVLIST_TIMEOUT) {
-            if (min_heap_elt_is_top_(ev))
+            if (!base->timewheel && min_heap_elt_is_top_(ev))
                 notify = 1;
             event_queue_remove(base, ev, EVLIST_TIMEOUT);
         }
@@ -1409,7 +2132,11 @@ int event_add_nolock(struct event *ev, const struct timeval *tv, int tv_is_absol
              * 如果ev插入到timer小根堆中，并且插入到根节点：需要告诉主线程早一点唤醒。
              * 我们仔细检查顶部元素的超时，以处理由于系统暂停引起的时间暂停。
              */
-            if (min_heap_elt_is_top_(ev))
+            if (base->timewheel) {
+                if (EVBASE_NEED_NOTIFY(base) && timer_wheel_elt_is_first(base->timewheel, ev))
+                    notify = 1;
+            }
+            else if (min_heap_elt_is_top_(ev))
                 notify = 1;
             else if ((top = min_heap_top_(&base->timeheap)) != NULL && evutil_timercmp(&top->ev_timeout, &now, <))
                 notify = 1;
@@ -1441,6 +2168,27 @@ int event_del(struct event *ev)
     return (res);
 }
 
+int event_remove_timer(struct event *ev)
+{
+    struct event_base *base = ev->ev_base;
+
+    if (EVUTIL_FAILURE_CHECK(!base)) {
+        event_warnx("%s: event has no event_base set.", __func__);
+        return -1;
+    }
+
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    //只移除超时，已注册的IO/信号和激活状态不变；永久事件的超时值一并清除，回调后不会重新加上超时
+    if (ev->ev_flags & EVLIST_TIMEOUT) {
+        event_queue_remove(base, ev, EVLIST_TIMEOUT);
+        if (ev->ev_closure == EV_CLOSURE_PERSIST)
+            evutil_timerclear(&ev->ev_.ev_io.ev_timeout);
+    }
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+    return 0;
+}
+
 int event_del_nolock(struct event *ev){
     struct event_base *base;
     int res = 0, notify = 0;
@@ -1459,6 +2207,8 @@ int event_del_nolock(struct event *ev){
      */
     base = ev->ev_base;
     if (base->current_event == ev && !EVBASE_IN_THREAD(base)) {
+        if (base->in_batch)
+            event_base_batch_end(base);
         ++base->current_event_waiters;
         EVTHREAD_COND_WAIT(base->current_event_cond, base->th_base_lock);
     }
@@ -1480,7 +2230,8 @@ int event_del_nolock(struct event *ev){
 
     if (ev->ev_flags & EVLIST_ACTIVE)
         event_queue_remove(base, ev,EVLIST_ACTIVE);
-    else if (ev->ev_flags & EVLIST_INSERTED) {
+    //已激活的事件也可能仍在注册队列中，需要一并移除
+    if (ev->ev_flags & EVLIST_INSERTED) {
         event_queue_remove(base, ev,EVLIST_INSERTED);
         if (ev->ev_events & (EV_READ|EV_WRITE))
             res = evmap_io_del(base, ev->ev_fd, ev);
@@ -1500,6 +2251,116 @@ int event_del_nolock(struct event *ev){
     return (res);
 }
 
+/*
+ * 开始批量操作：通知推迟到结束时；有超时事件时只读一次时钟；nheap个新的小根堆超时事件不少于堆中已有的事件时，
+ * 先追加再统一建堆，比逐个插入便宜
+ */
+static int event_base_batch_begin(struct event_base *base, int has_timeouts, int nheap)
+{
+    unsigned size = min_heap_size_(&base->timeheap);
+
+    EVENT_BASE_ASSERT_LOCKED(base);
+    base->in_batch = 1;
+    base->batch_notify = 0;
+    if (has_timeouts && !base->time_cache_ns) {
+        gettime_ns(base, &base->time_cache_ns);
+        base->batch_time_cached = 1;
+    }
+    base->batch_top_key = size ? min_heap_top_key_(&base->timeheap) : INT64_MAX;
+    if (nheap > 0 && (unsigned)nheap >= size) {
+        if (min_heap_reserve_(&base->timeheap, size + nheap) == -1)
+            return -1;
+        base->timeheap_bulk = 1;
+    }
+    return 0;
+}
+
+//结束批量操作：需要时重新建堆；堆顶变早了或者有推迟的通知时唤醒主线程
+static void event_base_batch_end(struct event_base *base)
+{
+    EVENT_BASE_ASSERT_LOCKED(base);
+    if (base->timeheap_bulk) {
+        min_heap_heapify_(&base->timeheap);
+        base->timeheap_bulk = 0;
+        if (!min_heap_empty_(&base->timeheap) && min_heap_top_key_(&base->timeheap) < base->batch_top_key)
+            base->batch_notify = 1;
+    }
+    if (base->batch_time_cached) {
+        base->time_cache_ns = 0;
+        base->batch_time_cached = 0;
+    }
+    base->in_batch = 0;
+    if (base->batch_notify && EVBASE_NEED_NOTIFY(base))
+        evthread_notify_base(base);
+    base->batch_notify = 0;
+}
+
+int event_add_many(struct event **evs, const struct timeval *tvs, int n)
+{
+    int res = 0;
+
+    for (int i = 0; i < n;) {
+        struct event_base *base = evs[i]->ev_base;
+        int end, nheap = 0;
+
+        if (EVUTIL_FAILURE_CHECK(!base)) {
+            event_warnx("%s: event has no event_base set.", __func__);
+            res = -1;
+            ++i;
+            continue;
+        }
+        //同一个base的一段连续事件一起处理
+        for (end = i; end < n && evs[end]->ev_base == base; ++end) {
+            if (tvs && !base->timewheel && !is_common_timeout(&tvs[end], base) && !(evs[end]->ev_flags & EVLIST_TIMEOUT))
+                ++nheap;
+        }
+
+        EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+        if (event_base_batch_begin(base, tvs != NULL, nheap) < 0)
+            res = -1;
+        for (; i < end; ++i) {
+            if (event_add_nolock(evs[i], tvs ? &tvs[i] : NULL, 0) < 0)
+                res = -1;
+        }
+        if (base->in_batch)
+            event_base_batch_end(base);
+        EVBASE_RELEASE_LOCK(base, th_base_lock);
+    }
+
+    return (res);
+}
+
+int event_del_many(struct event **evs, int n)
+{
+    int res = 0;
+
+    for (int i = 0; i < n;) {
+        struct event_base *base = evs[i]->ev_base;
+        int end;
+
+        if (EVUTIL_FAILURE_CHECK(!base)) {
+            event_warnx("%s: event has no event_base set.", __func__);
+            res = -1;
+            ++i;
+            continue;
+        }
+        for (end = i; end < n && evs[end]->ev_base == base; ++end)
+            ;
+
+        EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+        event_base_batch_begin(base, 0, 0);
+        for (; i < end; ++i) {
+            if (event_del_nolock(evs[i]) < 0)
+                res = -1;
+        }
+        if (base->in_batch)
+            event_base_batch_end(base);
+        EVBASE_RELEASE_LOCK(base, th_base_lock);
+    }
+
+    return (res);
+}
+
 void event_active(struct event *ev, int res, short ncalls)
 {
     if (EVUTIL_FAILURE_CHECK(!ev->ev_base)) {
@@ -1552,7 +2413,7 @@ void event_active_nolock(struct event *ev, int res, short ncalls) {
 void event_free(struct event *ev)
 {
     event_del(ev);
-    mm_free(ev);
+    event_base_pool_put_(ev->ev_base, EVENT_POOL_EVENT, ev, sizeof(struct event));
 }
 
 int event_initialized(const struct event *ev)
@@ -1580,10 +2441,13 @@ int event_reinit(struct event_base *base)
         event_queue_remove(base, &base->sig.ev_signal, EVLIST_INSERTED);
         if (base->sig.ev_signal.ev_flags & EVLIST_ACTIVE)
             event_queue_remove(base, &base->sig.ev_signal, EVLIST_ACTIVE);
+        //置为-1，避免evsig_dealloc再次关闭
         if (base->sig.ev_signal_pair[0] != -1)
             close(base->sig.ev_signal_pair[0]);
         if (base->sig.ev_signal_pair[1] != -1)
             close(base->sig.ev_signal_pair[1]);
+        base->sig.ev_signal_pair[0] = -1;
+        base->sig.ev_signal_pair[1] = -1;
         base->sig.ev_signal_added = 0;
     }
     if (base->th_notify_fd[0] != -1) {
@@ -1609,6 +2473,8 @@ int event_reinit(struct event_base *base)
         goto done;
     }
 
+    /* 未提交的改动针对的是旧的后端，丢弃；下面重新添加所有事件 */
+    event_changelist_freemem(&base->changelist);
     evmap_io_clear(&base->io);
     evmap_signal_clear(&base->sigmap);
 
@@ -1628,6 +2494,9 @@ int event_reinit(struct event_base *base)
 
     if (was_notifiable && res == 0)
         res = evthread_make_base_notifiable(base);
+    //旧的通知管道已经关闭，未执行的投递任务由下一轮事件循环处理
+    base->post_queue.notify_pending = 0;
+    base->defer_queue.inbox_notify_pending = 0;
 
 done:
     EVBASE_RELEASE_LOCK(base, th_base_lock);
@@ -1690,6 +2559,8 @@ static void event_queue_insert(struct event_base *base, struct event *ev, int qu
             break;
         case EVLIST_ACTIVE:
             base->event_count_active++;
+            base->nactive_per_pri[ev->ev_pri]++;
+            base->active_bitmap[ev->ev_pri >> 6] |= (uint64_t)1 << (ev->ev_pri & 63);
             TAILQ_INSERT_TAIL(&base->activequeues[ev->ev_pri], ev,ev_active_next);
             break;
         case EVLIST_TIMEOUT: {
@@ -1697,6 +2568,10 @@ static void event_queue_insert(struct event_base *base, struct event *ev, int qu
                 struct common_timeout_list *ctl = get_common_timeout_list(base, &ev->ev_timeout);
                 insert_common_timeout_inorder(ctl, ev);
             }
+            else if (base->timewheel)
+                timer_wheel_add(base->timewheel, ev);
+            else if (base->timeheap_bulk)
+                min_heap_append_(&base->timeheap, ev);
             else
                 min_heap_push_(&base->timeheap, ev);
             break;
@@ -1727,12 +2602,17 @@ static void event_queue_remove(struct event_base *base, struct event *ev, int qu
         case EVLIST_ACTIVE:
             base->event_count_active--;
             TAILQ_REMOVE(&base->activequeues[ev->ev_pri], ev, ev_active_next);
+            if (--base->nactive_per_pri[ev->ev_pri] == 0)
+                base->active_bitmap[ev->ev_pri >> 6] &= ~((uint64_t)1 << (ev->ev_pri & 63));
             break;
         case EVLIST_TIMEOUT:
             if (is_common_timeout(&ev->ev_timeout, base)) {
                 struct common_timeout_list *ctl = get_common_timeout_list(base, &ev->ev_timeout);
                 TAILQ_REMOVE(&ctl->events, ev, ev_timeout_pos.ev_next_with_common_timeout);
             }
+            else if (base->timewheel) {
+                timer_wheel_del(base->timewheel, ev);
+            }
             else {
                 min_heap_erase_(&base->timeheap, ev);
             }
@@ -1826,6 +2706,28 @@ static void evthread_notify_drain_default(int fd, short what, void *arg)
     EVBASE_RELEASE_LOCK(base, th_base_lock);
 }
 
+//eventfd：写入只累加8字节的计数器，计数器溢出时才会EAGAIN，此时事件循环一定会被唤醒
+static int evthread_notify_base_eventfd(struct event_base *base)
+{
+    uint64_t msg = 1;
+    int r = write(base->th_notify_fd[0], &msg, sizeof(msg));
+
+    return (r < 0 && ! EVUTIL_ERR_IS_EAGAIN(errno)) ? -1 : 0;
+}
+
+//一次read就清零计数器
+static void evthread_notify_drain_eventfd(int fd, short what, void *arg)
+{
+    uint64_t msg;
+    struct event_base *base = (struct event_base *)arg;
+    if (read(fd, &msg, sizeof(msg)) < 0 && !EVUTIL_ERR_IS_EAGAIN(errno))
+        event_sock_warn(fd, "Error reading from eventfd");
+
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    base->is_notify_pending = 0;
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+
 static int evthread_make_base_notifiable_nolock_(struct event_base *base)
 {
     void (*cb)(int, short, void *);
@@ -1836,7 +2738,14 @@ static int evthread_make_base_notifiable_nolock_(struct event_base *base)
         return 0;
     }
 
-    if (evutil_make_internal_pipe(base->th_notify_fd) == 0) {
+    //优先使用eventfd，只占用一个fd，失败时使用管道
+    base->th_notify_fd[0] = evutil_eventfd(0);
+    if (base->th_notify_fd[0] >= 0) {
+        base->th_notify_fd[1] = -1;
+        notify = evthread_notify_base_eventfd;
+        cb = evthread_notify_drain_eventfd;
+    }
+    else if (evutil_make_internal_pipe(base->th_notify_fd) == 0) {
         notify = evthread_notify_base_default;
         cb = evthread_notify_drain_default;
     }
@@ -160,6 +160,7 @@ int evbuffer_add_vprintf(struct evbuffer *buf, const char *fmt, va_list ap)__att
 /* 用于网络IO*/
 int evbuffer_write(struct evbuffer *buffer, int fd);
 int evbuffer_write_atmost(struct evbuffer *buffer, int fd, ssize_t howmuch);
+//从fd最多读取howmuch字节（不超过1M），howmuch为负数时读取4096字节
 int evbuffer_read(struct evbuffer *buffer, int fd, int howmuch);
 
 /** 传递给evbuffer_cb_func evbuffer回调函数的数据结构 */
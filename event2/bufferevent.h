@@ -70,7 +70,19 @@ enum bufferevent_options {
     BEV_OPT_DEFER_CALLBACKS = (1<<2),
 
     /* 如果设置，回调执行时没有锁在bufferevent上，这个操作需要BEV_OPT_DEFER_CALLBACKS被设置。*/
-    BEV_OPT_UNLOCK_CALLBACKS = (1<<3)
+    BEV_OPT_UNLOCK_CALLBACKS = (1<<3),
+
+    /*
+     * 只支持socket bufferevent。如果设置，没有在等待可写事件时写入的数据，在当前这批回调结束后（下一次IO复用之前）直接写套接字，
+     * 同一批回调中的多次写入合并成一次writev；只有写不完的部分才注册可写事件
+     */
+    BEV_OPT_EAGER_WRITE = (1<<4),
+
+    /*
+     * 只支持socket bufferevent。如果设置，读写事件使用边缘触发（EV_ET），每次唤醒循环读/写到EAGAIN，最多256K字节，
+     * 预算用完后重新激活事件；写完后可写事件保持注册。后端不支持边缘触发时仍然使用电平触发，只保留循环读写
+     */
+    BEV_OPT_EDGE_TRIGGERED = (1<<5)
 };
 
 /** 在现有套接字上创建一个新的套接字bufferevent，options是BEV_OPT_*  */
@@ -84,6 +96,21 @@ int bufferevent_socket_connect(struct bufferevent *, struct sockaddr *, int);
 /**获取dns错误码*/
 int bufferevent_socket_get_dns_error(struct bufferevent *bev);
 
+/*
+ * 输出缓冲区写完后不立即删除可写事件，而是保留注册（不计写超时），直到连续idle_wakeups次可写唤醒都没有数据可写才删除
+ * 请求/响应模式下下一次响应不用再重新添加EPOLLOUT，省去每次响应两次epoll_ctl；代价是电平触发时空闲期间每轮循环都会被唤醒
+ * 空闲唤醒不会调用用户的写回调；idle_wakeups为0时写完立即删除（默认）
+ * 只支持socket bufferevent，成功返回0，失败返回-1
+ */
+int bufferevent_socket_set_write_linger(struct bufferevent *bev, int idle_wakeups);
+
+/*
+ * 设置每次从套接字读取的字节数的范围（默认[512, 65536]，初始4096），max不超过1M
+ * 读满时读取大小扩大4倍，连续两次读到的不到一半时缩小一半（类似Netty的AdaptiveRecvByteBufAllocator）
+ * 只支持socket bufferevent，成功返回0，失败返回-1
+ */
+int bufferevent_socket_set_read_size(struct bufferevent *bev, size_t min, size_t max);
+
 /** 为一个特定的event_base分配一个bufferevent。*/
 int bufferevent_base_set(struct event_base *base, struct bufferevent *bufev);
 
@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <stdio.h>
+#include <stdint.h>
 #include "util.h"
 #include "event_struct.h"
 
@@ -13,10 +14,11 @@ struct event_base *event_base_new();
 //event_base_loop的标志
 #define EVLOOP_ONCE	    0x01    //阻塞直到我们有激活事件，所有激活事件执行回调后退出
 #define EVLOOP_NONBLOCK	0x02    //非阻塞：事件就绪，执行高优先级的回调，然后退出
+#define EVLOOP_NO_EXIT_ON_EMPTY 0x04 //没有未决事件时不退出，直到event_base_loopbreak或者event_base_loopexit
 
 /*
  * 事件循环，成功返回0，有错误发生返回-1，如果因为没有未决/就绪事件退出返回1
- * flags : EVLOOP_ONCE | EVLOOP_NONBLOCK的组合
+ * flags : EVLOOP_ONCE | EVLOOP_NONBLOCK | EVLOOP_NO_EXIT_ON_EMPTY的组合
  */
 int event_base_dispatch(struct event_base *);
 int event_base_loop(struct event_base *, int);
@@ -34,6 +36,76 @@ int	event_base_priority_init(struct event_base *, int);
 //获取激活事件队列的数量
 int	event_base_get_npriorities(struct event_base *);
 
+//获取优先级pri的激活事件数（包括内部事件），可以用来判断负载并丢弃低优先级的请求；pri无效时返回-1
+int event_base_get_num_active(struct event_base *base, int pri);
+
+/*
+ * 设置优先级pri每轮事件循环最多执行的回调数，budget为0表示不限制
+ * 默认只处理最高优先级的非空激活队列，低优先级可能一直得不到处理；设置过任一预算后，每轮按优先级从高到低
+ * 依次处理所有非空队列，每个队列最多执行其预算个回调（加权轮询），剩下的留到下一轮
+ * 成功返回0，失败返回-1
+ */
+int event_base_set_priority_budget(struct event_base *base, int pri, int budget);
+
+//返回忙轮询的自旋时间（微秒），0表示没有开启忙轮询
+int event_base_get_busy_poll(const struct event_base *base);
+
+//对数分桶的直方图：buckets[0]统计0，buckets[i]统计[2^(i-1), 2^i)，最后一个桶还包含所有更大的值
+#define EVENT_STATS_HIST_BUCKETS 40
+struct event_stats_histogram {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[EVENT_STATS_HIST_BUCKETS];
+};
+
+//event_base的运行统计，所有值从event_base创建开始累计，两次读取相减即为这段时间的统计
+struct event_base_stats {
+    uint64_t loop_iterations;//事件循环的轮数
+    uint64_t busy_poll_spins;//忙轮询中超时为0的dispatch次数
+    uint64_t busy_poll_hits;//忙轮询期间发现事件，不需要阻塞的次数
+    uint64_t busy_poll_sleeps;//自旋结束仍然没有事件，阻塞等待的次数
+    uint64_t deferred_depth;//获取统计时延迟回调队列中等待的数量
+    uint64_t deferred_depth_max;//每轮事件循环处理延迟回调前队列深度的最大值
+    uint64_t deferred_oldest_wait_ns;//获取统计时最早调度的延迟回调已经等待的时间，纳秒，只在设置了EVENT_BASE_FLAG_COLLECT_STATS时统计
+
+    //以下直方图只在设置了EVENT_BASE_FLAG_COLLECT_STATS时统计，每轮事件循环记录一次（定时器延迟每个定时器记录一次）
+    struct event_stats_histogram dispatch_wait_ns;//在后端dispatch中（包括忙轮询）花费的时间，纳秒
+    struct event_stats_histogram process_active_ns;//dispatch返回后处理定时器、投递任务、激活事件和延迟回调花费的时间，纳秒
+    struct event_stats_histogram callbacks_per_iteration;//执行的事件回调数
+    struct event_stats_histogram events_per_dispatch;//一次dispatch激活的事件数
+    struct event_stats_histogram deferred_per_iteration;//执行的延迟回调数
+    struct event_stats_histogram deferred_wait_ns;//延迟回调从调度到开始执行等待的时间，纳秒，每个延迟回调记录一次
+    struct event_stats_histogram timer_lateness_ns;//定时器被激活的时间减去超时时间，纳秒，精度为微秒
+};
+
+//获取event_base的运行统计，成功返回0，失败返回-1
+int event_base_get_stats(struct event_base *base, struct event_base_stats *stats);
+
+//返回直方图中不小于p（0到1）比例的样本所在桶的上界，没有样本时返回0
+uint64_t event_stats_histogram_percentile(const struct event_stats_histogram *h, double p);
+
+//执行时间超过阈值的回调的信息
+struct event_slow_callback_info {
+    void *callback;//回调函数指针：事件回调或者延迟回调
+    void *arg;//回调函数的参数
+    int fd;//事件的fd，信号事件为信号值，延迟回调和没有fd的事件为-1
+    short events;//触发回调的事件（EV_READ|EV_WRITE|EV_TIMEOUT|EV_SIGNAL），延迟回调为0
+    int is_deferred;//是否是延迟回调（bufferevent、evbuffer的回调等）
+    uint64_t duration_ns;//回调执行的时间，纳秒
+};
+
+//慢回调的钩子，在事件循环线程中、回调返回之后调用，调用时不持有event_base的锁
+typedef void (*event_slow_callback_fn)(struct event_base *base, const struct event_slow_callback_info *info, void *arg);
+
+/*
+ * 设置慢回调检测：事件回调或者延迟回调执行时间超过threshold时调用fn报告。fn为NULL时关闭检测
+ * 阈值不小于粗粒度时钟精度（通常为1到4毫秒）的4倍时使用CLOCK_MONOTONIC_COARSE计时，开销很小；否则使用CLOCK_MONOTONIC
+ * 成功返回0，失败返回-1
+ */
+int event_base_set_slow_callback_hook(struct event_base *base, const struct timeval *threshold,
+                                      event_slow_callback_fn fn, void *arg);
+
 //获取event_base当前使用的IO复用的名字
 const char *event_base_get_method(const struct event_base *);
 
@@ -89,6 +161,14 @@ void event_base_dump_events(struct event_base *, FILE *);
 int event_base_once(struct event_base *base,int fd, short events,
                     void (*callback)(int,short,void*),void *arg,const struct timeval *tv);
 
+/*
+ * 把fn(arg)投递到base的事件循环线程中执行，可以在任意线程中调用，不需要获取base的锁
+ * 任务按投递顺序在事件循环的下一轮中执行，两次dispatch之间的多次投递只唤醒事件循环一次
+ * 跨线程投递需要base支持线程通知（evthread_use_pthreads之后创建）；event_base_free时未执行的任务被丢弃
+ * 成功返回0，失败返回-1
+ */
+int event_base_post(struct event_base *base, void (*fn)(void *), void *arg);
+
 const struct timeval *event_base_init_common_timeout(struct event_base *base, const struct timeval *duration);
 
 //event设置权限值，如果事件ev已经就绪，设置失败
@@ -163,6 +243,38 @@ enum event_base_config_flag
 
     /* 在执行event_base_loop的时候没有cache时间。该函数的while循环会经常取系统时间，如果cache时间，那么就取cache的。如果没有的话，就只能通过系统提供的函数来获取系统时间*/
     EVENT_BASE_FLAG_NO_CACHE_TIME = 0x08,
+
+    /* 使用epoll后端时，把一次循环中的事件增删改动记录在changelist中，同一fd的改动合并，在epoll_wait之前统一提交，
+     * 相互抵消的改动不产生系统调用。注意：fd关闭前必须先删除其上的事件，否则dup出的新fd可能受到影响*/
+    EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST = 0x10,
+
+    /* 使用精确到微秒的定时器：epoll后端优先使用epoll_pwait2，内核不支持时使用加入epoll的timerfd；
+     * 默认情况下超时向上取整到毫秒。epoll_pwait2的超时受线程timer slack（默认50us）影响，
+     * 需要更高精度时可以在事件循环线程中用prctl(PR_SET_TIMERSLACK)调小 */
+    EVENT_BASE_FLAG_PRECISE_TIMER = 0x20,
+
+    /* 统计事件循环的延迟直方图（见struct event_base_stats），每轮事件循环增加几次读时钟的开销；不设置时几乎没有开销 */
+    EVENT_BASE_FLAG_COLLECT_STATS = 0x40,
+
+    /* 用signalfd接收信号：添加信号事件时在调用线程中阻塞该信号，由加入后端的signalfd一次读出一批信号，不安装信号处理函数，
+     * 不同的event_base可以各自拥有不同的信号。进程收到的信号可能投递给任意一个没有阻塞它的线程，所以应该在创建其它线程之前
+     * 添加信号事件（新线程继承信号掩码），或者在所有线程中阻塞这些信号。signalfd不可用时退回信号处理函数 */
+    EVENT_BASE_FLAG_USE_SIGNALFD = 0x80,
+};
+
+//event_base的时钟源，用于时间缓存和超时
+enum event_clock_source
+{
+    /* clock_gettime(CLOCK_MONOTONIC)，默认 */
+    EVENT_CLOCK_MONOTONIC = 0,
+
+    /* clock_gettime(CLOCK_MONOTONIC_COARSE)，开销约为CLOCK_MONOTONIC的1/5，但精度只有一个jiffy（1~4毫秒），
+     * 定时器可能晚一个jiffy触发，短于一个jiffy的定时器会让事件循环多醒来几次 */
+    EVENT_CLOCK_MONOTONIC_COARSE = 1,
+
+    /* 直接读TSC，按创建第一个使用它的event_base时（阻塞约10毫秒）校准的频率换算成纳秒；
+     * 要求CPU有不变TSC（invariant TSC），不满足时退回EVENT_CLOCK_MONOTONIC */
+    EVENT_CLOCK_TSC = 2,
 };
 
 //分配一个event_config的对象，event_config对象用于改变event_base的行为
@@ -179,6 +291,39 @@ int event_config_set_num_cpus_hint(struct event_config *cfg, int cpus);
 int event_config_require_features(struct event_config *cfg,  int feature);
 int event_config_set_flag(struct event_config *cfg, int flag);
 
+//使用分层时间轮代替小根堆管理（非公共）超时事件，插入和删除为O(1)；tick为时间轮精度，为NULL时使用默认的1毫秒，
+//定时器最多延迟一个tick触发，不会提前
+int event_config_set_timer_wheel(struct event_config *cfg, const struct timeval *tick);
+
+//一轮事件循环最多执行max_callbacks个事件回调，之后即使还有激活事件也先回到IO复用检查新事件，<=0表示不限制
+int event_config_set_max_dispatch_callbacks(struct event_config *cfg, int max_callbacks);
+
+/*
+ * 一轮事件循环最多执行max_callbacks个延迟回调（BEV_OPT_DEFER_CALLBACKS等），剩下的留到下一轮
+ * <=0表示根据队列深度自适应（默认）：每轮执行队列中的一半，不少于16个，不多于4096个
+ */
+int event_config_set_max_deferred_callbacks(struct event_config *cfg, int max_callbacks);
+
+/*
+ * 忙轮询：事件循环需要阻塞等待时，先以超时为0调用后端dispatch自旋spin时间（不超过下一个定时器），期间发现事件立即处理，
+ * 自旋结束仍没有事件时才阻塞等待。用一个CPU核换取阻塞唤醒的延迟。spin为NULL时使用默认的50微秒
+ * 同时会对listener接受的和bufferevent_socket创建的套接字设置SO_BUSY_POLL（需要CAP_NET_ADMIN，失败时忽略）
+ */
+int event_config_set_busy_poll(struct event_config *cfg, const struct timeval *spin);
+
+/*
+ * 开启event_base的对象池：event_new、event_base_once、bufferevent_socket_new分配的对象以及bufferevent的输入输出缓冲区
+ * 释放时放回所属event_base的池中，下次分配直接复用，每种对象最多缓存max_cached个，<=0表示不使用（默认）
+ * 池中的对象在event_base_free时释放，所以这些对象必须在event_base_free之前释放
+ */
+int event_config_set_object_pool(struct event_config *cfg, int max_cached);
+
+//设置event_base的时钟源，默认为EVENT_CLOCK_MONOTONIC
+int event_config_set_clock(struct event_config *cfg, enum event_clock_source clock);
+
+//返回event_base实际使用的时钟源
+enum event_clock_source event_base_get_clock(const struct event_base *base);
+
 //在event_config中设置被禁止的IO复用方法，method是IO复用的名称
 int event_config_avoid_method(struct event_config *cfg, const char *method);
 
@@ -219,6 +364,19 @@ int event_add(struct event *ev, const struct timeval *timeout);
 /* 从监听的事件集合中移除事件*/
 int event_del(struct event *);
 
+/* 只移除事件的超时，事件仍然监听IO/信号；事件没有超时时什么也不做，成功返回0 */
+int event_remove_timer(struct event *ev);
+
+/*
+ * 批量添加n个事件，相当于对每个evs[i]调用event_add(evs[i], tvs ? &tvs[i] : NULL)
+ * 连续的属于同一个event_base的事件只加锁一次、至多唤醒一次事件循环；超时事件很多时一次性重建小根堆而不是逐个插入
+ * 某个事件失败时继续处理其余事件，有任何失败返回-1，否则返回0
+ */
+int event_add_many(struct event **evs, const struct timeval *tvs, int n);
+
+/* 批量删除n个事件，相当于对每个evs[i]调用event_del，加锁和唤醒同event_add_many */
+int event_del_many(struct event **evs, int n);
+
 /* 使事件就绪，多线程程序中常用于从另一个线程唤醒运行event_base_loop（）的线程。 */
 void event_active(struct event *ev, int res, short ncalls);
 
@@ -0,0 +1,49 @@
+//
+// 多Reactor：一组event_base，每个event_base在自己的线程中运行事件循环，线程绑定到CPU核
+//
+
+#ifndef TNET_EVENT_GROUP_H
+#define TNET_EVENT_GROUP_H
+
+#include "event.h"
+
+struct event_base_group;
+
+//event_base_group_new的标志
+#define EVENT_BASE_GROUP_NO_PIN 0x01 //不把线程绑定到CPU核
+
+/*
+ * 创建n个event_base，n <= 0时使用当前进程可用的CPU核数
+ * cfg用于创建每个event_base，可以为NULL；会自动启用pthread锁，因为其它线程需要唤醒这些event_base
+ * 成功返回event_base_group，失败返回NULL
+ */
+struct event_base_group *event_base_group_new(int n, const struct event_config *cfg, int flags);
+
+//停止并等待所有事件循环结束，然后释放所有event_base，调用时不能有事件循环线程在使用这些event_base上的事件
+void event_base_group_free(struct event_base_group *group);
+
+//event_base的数量
+int event_base_group_size(const struct event_base_group *group);
+
+//获取第i个event_base
+struct event_base *event_base_group_get_base(const struct event_base_group *group, int i);
+
+//轮询选择一个event_base，线程安全
+struct event_base *event_base_group_next(struct event_base_group *group);
+
+//选择当前事件数（已添加和已激活）最少的event_base，读取时不加锁，结果是近似的
+struct event_base *event_base_group_least_loaded(struct event_base_group *group);
+
+/*
+ * 为每个event_base启动一个线程运行事件循环（EVLOOP_NO_EXIT_ON_EMPTY），没有事件时也不会退出
+ * 成功返回0，失败返回-1，失败时已经启动的线程会被停止
+ */
+int event_base_group_start(struct event_base_group *group);
+
+//通知所有事件循环退出，不等待，可以在任意线程（包括事件循环线程）中调用
+int event_base_group_stop(struct event_base_group *group);
+
+//等待所有事件循环线程退出，不能在事件循环线程中调用
+int event_base_group_join(struct event_base_group *group);
+
+#endif //TNET_EVENT_GROUP_H
@@ -32,19 +32,31 @@ struct name {					\
 }
 #endif
 
+#ifndef LIST_ENTRY
+#define EVENT_DEFINED_LISTENTRY_
+#define LIST_ENTRY(type)						\
+struct {								\
+	struct type *le_next;	/* next element */			\
+	struct type **le_prev;	/* address of previous next element */	\
+}
+#endif
+
 struct event_base;
+/*
+ * 字段按访问频率排列：前64字节是激活和分发事件时访问的字段（激活队列、回调、状态以及IO链表的next指针），
+ * 后面是添加/删除事件和处理超时才访问的字段
+ */
 struct event {
 	TAILQ_ENTRY(event) ev_active_next;// 就绪事件队列（激活事件队列）
-	TAILQ_ENTRY(event) ev_next;//注册事件队列
-    //超时管理
-    union {
-        TAILQ_ENTRY(event) ev_next_with_common_timeout;//公共超时时间事件队列
-        int min_heap_idx;//该event在最小堆上的位置
-    }ev_timeout_pos;//仅仅用于定时事件
-
-	int ev_fd;//对于I/O事件，是文件描述符；对于signal事件，是信号值
-
+	void (*ev_callback)(int, short, void *arg);//事件的回调
+	void *ev_arg;//回调函数的参数
     struct event_base *ev_base;//event所属的event_base
+	int ev_fd;//对于I/O事件，是文件描述符；对于signal事件，是信号值
+    short ev_events;//记录监听的事件类型 EV_READ EVTIMEOUT之类
+    short ev_res;//当前激活事件的类型
+	short ev_flags;//事件当前的状态
+	uint8_t ev_pri;	//优先级，值越小优先级越高
+	uint8_t ev_closure;
 
     union {
         //IO事件
@@ -60,14 +72,15 @@ struct event {
         }ev_signal;
     }ev_;//由于是联合体  io事件和信号事件不可共存
 
-    short ev_events;//记录监听的事件类型 EV_READ EVTIMEOUT之类
-    short ev_res;//当前激活事件的类型
-	short ev_flags;//事件当前的状态
-	uint8_t ev_pri;	//优先级，值越小优先级越高
-	uint8_t ev_closure;
+    //超时管理
+    union {
+        TAILQ_ENTRY(event) ev_next_with_common_timeout;//公共超时时间事件队列
+        int min_heap_idx;//该event在最小堆上的位置
+        LIST_ENTRY(event) ev_next_with_timer_wheel;//时间轮槽位链表
+    }ev_timeout_pos;//仅仅用于定时事件
     struct timeval ev_timeout;//用于定时器,指定定时器的超时值
-	void (*ev_callback)(int, short, void *arg);//事件的回调
-	void *ev_arg;//回调函数的参数
+
+	TAILQ_ENTRY(event) ev_next;//注册事件队列
 };
 
 TAILQ_HEAD(event_list,event);
@@ -76,6 +89,10 @@ TAILQ_HEAD(event_list,event);
 #undef TAILQ_ENTRY
 #endif
 
+#ifdef EVENT_DEFINED_LISTENTRY_
+#undef LIST_ENTRY
+#endif
+
 #ifdef EVENT_DEFINED_TQHEAD_
 #undef TAILQ_HEAD
 #endif
@@ -62,6 +62,7 @@ int evutil_snprintf(char *buf, size_t buflen, const char *format, ...)__attribut
 	} while (0)
 
 #define	evutil_timerclear(tvp)	(tvp)->tv_sec = (tvp)->tv_usec = 0
+#define	evutil_timerisset(tvp)	((tvp)->tv_sec || (tvp)->tv_usec)
 
 //socket相关
 //closeexec标志打开文件
@@ -83,4 +84,7 @@ int evutil_make_listen_socket_reuseable_port(int sock);
 int evutil_make_socket_closeonexec(int sock);
 
 int evutil_make_tcp_listen_socket_deferred(int sock);
+
+//设置套接字的SO_BUSY_POLL，在没有数据时阻塞读最多忙轮询usec微秒；增大该值需要CAP_NET_ADMIN
+int evutil_make_socket_busy_poll(int sock, int usec);
 #endif //TNET_UTIL_H
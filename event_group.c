@@ -0,0 +1,210 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "event2/event.h"
+#include "event2/event_struct.h"
+#include "event2/event_group.h"
+#include "event2/thread.h"
+#include "event_internal.h"
+#include "evthread.h"
+#include "evmemory.h"
+#include "evlog.h"
+#include "evutil.h"
+
+struct event_base_group_member {
+    struct event_base_group *group;
+    struct event_base *base;
+    struct event stop_ev;//其它线程通过激活这个事件让事件循环退出，在事件循环开始之前激活也不会丢失
+    pthread_t thread;
+    int cpu;//绑定的CPU核，-1表示不绑定
+    int running;//线程是否已经启动
+};
+
+struct event_base_group {
+    int n;
+    int flags;
+    unsigned rr_next;//轮询的下一个下标，原子操作
+    struct event_base_group_member *members;
+};
+
+//获取可用的CPU核列表，返回核的数量
+static int event_base_group_cpus(int *cpus, int max)
+{
+    cpu_set_t set;
+    int n = 0;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return 0;
+    for (int i = 0; i < CPU_SETSIZE && n < max; ++i) {
+        if (CPU_ISSET(i, &set))
+            cpus[n++] = i;
+    }
+    return n;
+}
+
+static void event_base_group_stop_cb(int fd, short what, void *arg)
+{
+    struct event_base_group_member *m = (struct event_base_group_member *)arg;
+    event_base_loopbreak(m->base);
+}
+
+struct event_base_group *event_base_group_new(int n, const struct event_config *cfg, int flags)
+{
+    struct event_base_group *group;
+    int cpus[CPU_SETSIZE];
+    int ncpus;
+
+    if (!EVTHREAD_LOCKING_ENABLED() && evthread_use_pthreads() < 0) {
+        event_warnx("%s: unable to enable pthread locking", __func__);
+        return NULL;
+    }
+
+    ncpus = event_base_group_cpus(cpus, CPU_SETSIZE);
+    if (n <= 0)
+        n = ncpus > 0 ? ncpus : 1;
+
+    if ((group = (struct event_base_group *)mm_calloc(1, sizeof(struct event_base_group))) == NULL) {
+        event_warn("%s: calloc", __func__);
+        return NULL;
+    }
+    group->flags = flags;
+    group->members = (struct event_base_group_member *)mm_calloc(n, sizeof(struct event_base_group_member));
+    if (group->members == NULL) {
+        event_warn("%s: calloc", __func__);
+        goto err;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        struct event_base_group_member *m = &group->members[i];
+        m->group = group;
+        m->cpu = (!(flags & EVENT_BASE_GROUP_NO_PIN) && ncpus > 0) ? cpus[i % ncpus] : -1;
+        m->base = cfg ? event_base_new_with_config(cfg) : event_base_new();
+        if (m->base == NULL)
+            goto err;
+        ++group->n;
+        event_assign(&m->stop_ev, m->base, -1, 0, event_base_group_stop_cb, m);
+    }
+
+    return group;
+err:
+    event_base_group_free(group);
+    return NULL;
+}
+
+void event_base_group_free(struct event_base_group *group)
+{
+    if (group == NULL)
+        return;
+
+    event_base_group_stop(group);
+    event_base_group_join(group);
+
+    for (int i = 0; i < group->n; ++i) {
+        event_del(&group->members[i].stop_ev);
+        event_base_free(group->members[i].base);
+    }
+    if (group->members)
+        mm_free(group->members);
+    mm_free(group);
+}
+
+int event_base_group_size(const struct event_base_group *group)
+{
+    return group->n;
+}
+
+struct event_base *event_base_group_get_base(const struct event_base_group *group, int i)
+{
+    if (i < 0 || i >= group->n)
+        return NULL;
+    return group->members[i].base;
+}
+
+struct event_base *event_base_group_next(struct event_base_group *group)
+{
+    unsigned i = __atomic_fetch_add(&group->rr_next, 1, __ATOMIC_RELAXED);
+    return group->members[i % group->n].base;
+}
+
+struct event_base *event_base_group_least_loaded(struct event_base_group *group)
+{
+    struct event_base *best = NULL;
+    int best_load = 0;
+
+    for (int i = 0; i < group->n; ++i) {
+        struct event_base *base = group->members[i].base;
+        int load = __atomic_load_n(&base->event_count, __ATOMIC_RELAXED) +
+                   __atomic_load_n(&base->event_count_active, __ATOMIC_RELAXED);
+        if (best == NULL || load < best_load) {
+            best = base;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static void *event_base_group_thread(void *arg)
+{
+    struct event_base_group_member *m = (struct event_base_group_member *)arg;
+
+    if (m->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(m->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            event_warnx("%s: unable to pin loop thread to cpu %d", __func__, m->cpu);
+    }
+
+    if (event_base_loop(m->base, EVLOOP_NO_EXIT_ON_EMPTY) < 0)
+        event_warnx("%s: event loop exited with an error", __func__);
+
+    return NULL;
+}
+
+int event_base_group_start(struct event_base_group *group)
+{
+    for (int i = 0; i < group->n; ++i) {
+        struct event_base_group_member *m = &group->members[i];
+        if (m->running)
+            continue;
+        if (pthread_create(&m->thread, NULL, event_base_group_thread, m) != 0) {
+            event_warn("%s: pthread_create", __func__);
+            event_base_group_stop(group);
+            event_base_group_join(group);
+            return -1;
+        }
+        m->running = 1;
+    }
+    return 0;
+}
+
+int event_base_group_stop(struct event_base_group *group)
+{
+    for (int i = 0; i < group->n; ++i) {
+        struct event_base_group_member *m = &group->members[i];
+        if (m->running)
+            event_active(&m->stop_ev, EV_TIMEOUT, 1);
+    }
+    return 0;
+}
+
+int event_base_group_join(struct event_base_group *group)
+{
+    int r = 0;
+
+    for (int i = 0; i < group->n; ++i) {
+        struct event_base_group_member *m = &group->members[i];
+        if (!m->running)
+            continue;
+        if (pthread_join(m->thread, NULL) != 0) {
+            event_warn("%s: pthread_join", __func__);
+            r = -1;
+            continue;
+        }
+        m->running = 0;
+    }
+    return r;
+}
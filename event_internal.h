@@ -6,6 +6,7 @@
 #include "event2/event_struct.h"
 #include "evsignal.h"
 #include "minheap.h"
+#include "evtimewheel.h"
 #include "evmemory.h"
 #include "defer.h"
 
@@ -39,7 +40,26 @@ struct eventop {
     size_t fdinfo_len;//用于一个或者多个激活事件的fd的额外信息的长度，信息记录在evmap中，作为add和del的入参
 };
 
-#define event_io_map event_signal_map
+#ifdef TNET_SINGLE_THREAD
+/* 单线程构建只使用epoll后端（不使用changelist），IO事件的增删和dispatch直接调用，不经过evsel函数指针 */
+int epoll_add(struct event_base *base, int fd, short old, short events, void *p);
+int epoll_del(struct event_base *base, int fd, short old, short events, void *p);
+int epoll_dispatch(struct event_base *base, struct timeval *tv);
+#define EVSEL_ADD(base, fd, old, events, fdinfo) epoll_add((base), (fd), (old), (events), (fdinfo))
+#define EVSEL_DEL(base, fd, old, events, fdinfo) epoll_del((base), (fd), (old), (events), (fdinfo))
+#define EVSEL_DISPATCH(base, tv) epoll_dispatch((base), (tv))
+#else
+#define EVSEL_ADD(base, fd, old, events, fdinfo) ((base)->evsel->add((base), (fd), (old), (events), (fdinfo)))
+#define EVSEL_DEL(base, fd, old, events, fdinfo) ((base)->evsel->del((base), (fd), (old), (events), (fdinfo)))
+#define EVSEL_DISPATCH(base, tv) ((base)->evsel->dispatch((base), (tv)))
+#endif
+
+//fd到evmap_io的映射：一个连续数组，下标就是fd，每一项是struct evmap_io加上后端需要的fdinfo
+struct event_io_map{
+    char *entries;//evmap_io连续数组，扩容时整体移动
+    int nentries;//entries中可用的项目数
+    int entry_size;//每一项的大小，第一次扩容时根据后端的fdinfo_len确定
+};
 
 struct event_signal_map{
     void **entries;//执行evmap_io或者evmap_signal的指针数组，二级指针
@@ -78,23 +98,61 @@ struct event_change{
 /* 为添加ET事件设置 */
 #define EV_CHANGE_ET      EV_ET
 
+//一次事件循环中尚未提交给后端的改动列表，每个fd最多一项
+struct event_changelist {
+    struct event_change *changes;
+    int n_changes;
+    int changes_size;
+};
+
+//使用changelist的后端的fdinfo，记录fd在changes中的下标+1，为0时表示没有改动
+struct event_changelist_fdinfo {
+    int idxplus1;
+};
+
+//event_base_post投递的任务，每次投递分配一个
+struct event_post_node {
+    struct event_post_node *next;
+    void (*fn)(void *);
+    void *arg;
+};
+
+/*
+ * 无锁的多生产者单消费者队列（Vyukov），生产者只修改head，事件循环线程只修改tail
+ * head和tail放在不同的cache line上，避免生产者和消费者互相干扰
+ */
+struct event_post_queue {
+    struct event_post_node *head;//最后入队的节点，生产者原子交换
+    char pad_head[EVENT_CACHELINE - sizeof(struct event_post_node *)];
+    struct event_post_node *tail;//下一个出队的节点，只在事件循环线程中访问
+    struct event_post_node stub;//占位节点，队列为空时head和tail都指向它
+    char pad_tail[EVENT_CACHELINE - sizeof(struct event_post_node *) - sizeof(struct event_post_node)];
+    int notify_pending;//为1时已经唤醒了事件循环，后续投递不再唤醒，事件循环取任务前清零
+};
 
 //调试模式是否打开的标志
 #define EVENT_DEBUG_MODE_IS_ON() (0)
 
 /* 结构体event_base是Libevent的Reactor */
+//event_base对象池回收的对象类型
+enum event_pool_kind {
+    EVENT_POOL_EVENT,//event_new
+    EVENT_POOL_EVENT_ONCE,//event_base_once
+    EVENT_POOL_BUFFEREVENT,//bufferevent_socket_new
+    EVENT_POOL_EVBUFFER,//bufferevent的输入输出缓冲区
+    EVENT_POOL_N
+};
+
+/*
+ * 字段按访问的线程分组：开头是事件循环每轮都访问的字段，中间是添加/删除事件和后台维护用到的字段，
+ * 最后是其它线程会写的字段（通知标志、延迟回调和投递任务的收件箱），用填充和前面的字段隔开，避免伪共享
+ */
 struct event_base{
     /* 初始化Reactor时选择的一种后端IO复用机制，并记录在如下字段中 */
     const struct eventop *evsel;
     /*指向IO复用机制真正存储的数据，它通过evsel成员的init函数来进行初始化，类似于类和静态函数的关系，evbase是evsel的实例*/
     void *evbase;
 
-    const struct eventop *evsigsel;//指向信号的后端处理机制
-    /* 信号事件处理器使用的数据结构，其中封装了一个由socketpair创建的管道。它用于信号处理函数和事件多路分发器之间的通信 */
-    struct evsig_info sig;
-
-    int virtual_event_count;//虚拟事件数量
-    int event_count;//加入到该event_base的事件总数
     int event_count_active;//该event_base上就绪事件总数
 
     int event_gotterm;//是否在处理完活动事件队列上剩余的任务之后终止事件循环
@@ -103,45 +161,88 @@ struct event_base{
 
     int event_running_priority;//当前正在处理的活动事件队列的优先级
 
-    int running_loop;//事件循环是否启动
+    int max_dispatch_callbacks;//一轮事件循环最多执行的回调数，超过后回到IO复用，INT_MAX表示不限制
 
     /* 活动事件队列数组，索引值越小的队列，优先级越高。高优先级的活动事件队列中的事件处理器将被优先处理 */
     struct event_list *activequeues;
     int nactivequeues;//活动事件队列数组的大小，即该event_base共有nactivequeues个不同优先级的活动事件队列
+    int *nactive_per_pri;//每个优先级活动事件队列中的事件数
+    uint64_t active_bitmap[EVENT_MAX_PRIORITIES / 64];//第i位为1表示优先级i的活动事件队列非空
+    int *priority_budgets;//每个优先级一轮最多执行的回调数，0表示不限制；为NULL时只处理最高优先级的非空队列
+    int npriority_budgets;
+
+    int current_event_waiters;//等待条件变量而阻塞的线程数量
+    struct event *current_event;//当前事件循环正在执行哪个事件处理器的回调函数
+    unsigned long th_owner_id;
+    void *th_base_lock;//互斥锁
+    void *current_event_cond;//条件变量
+
+    /* 该event_base的一些配置参数 */
+    enum event_base_config_flag flags;
+
+    int clock_source;//时钟源，enum event_clock_source
+    int64_t time_cache_ns;//时间缓存，纳秒，0表示没有缓存
+    struct timeval busy_poll;//忙轮询的自旋时间，为0时不忙轮询
+
+    struct min_heap timeheap;/* 时间堆 */
+    struct timer_wheel *timewheel;/* 不为NULL时使用时间轮代替时间堆 */
+    struct event_io_map io;/* 文件描述符和IO事件之间的映射关系表 */
+    struct event_changelist changelist;/* 后端使用changelist时，待提交的fd改动 */
+
+    int running_loop;//事件循环是否启动
+
+    const struct eventop *evsigsel;//指向信号的后端处理机制
+    /* 信号事件处理器使用的数据结构，其中封装了一个由socketpair创建的管道。它用于信号处理函数和事件多路分发器之间的通信 */
+    struct evsig_info sig;
+
+    int virtual_event_count;//虚拟事件数量
+    int event_count;//加入到该event_base的事件总数
 
     /* 注册事件队列：所有被添加到event_base的事件队列，存放IO事件处理器和信号事件处理器*/
     struct event_list eventqueue;
 
-    /** 延迟回调函数的链表，事件循环每次成功处理完一个活动队列中的所有事件之后，调用一次延迟回调函数 */
-    struct deferred_cb_queue defer_queue;
-
     struct common_timeout_list **common_timeout_queues;/* 通用定时器队列 */
     int n_common_timeouts;/* common_timeout_queues项目数使用数目 */
     int n_common_timeouts_allocated;/* common_timeout_queues分配数目 */
 
-    struct event_io_map io;/* 文件描述符和IO事件之间的映射关系表 */
     struct event_signal_map sigmap;  /* 信号值和信号事件之间的映射关系表 */
-    struct min_heap timeheap;/* 时间堆 */
 
-    struct timeval tv_cache;//时间缓存
+    struct event_base_stats stats;/* 运行统计，持有锁时修改 */
+
+    struct mm_pool pools[EVENT_POOL_N];/* event_config_set_object_pool开启的对象池，持有锁时使用 */
+
+    /* 慢回调检测，slow_cb_fn为NULL时关闭 */
+    event_slow_callback_fn slow_cb_fn;
+    void *slow_cb_arg;
+    uint64_t slow_cb_threshold_ns;
+    int slow_cb_clock;//计时使用的时钟，enum event_clock_source
+
     struct timeval event_tv;/*used to detect when time is running backwards. */
     struct timeval tv_clock_diff;
     time_t last_updated_clock_diff;/* 上次更新tv_clock_diff的时间 */
 
-    unsigned long th_owner_id;
-    void *th_base_lock;//互斥锁
-    void *current_event_cond;//条件变量
-    int current_event_waiters;//等待条件变量而阻塞的线程数量
-    struct event *current_event;//当前事件循环正在执行哪个事件处理器的回调函数
-
-    /* 该event_base的一些配置参数 */
-    enum event_base_config_flag flags;
+    //event_add_many/event_del_many批量操作的状态，持有锁时修改
+    int in_batch;//为1：通知推迟到批量操作结束时
+    int batch_notify;//批量操作期间是否有需要推迟的通知
+    int timeheap_bulk;//为1：超时事件只追加到小根堆末尾，批量操作结束时统一建堆
+    int batch_time_cached;//为1：批量操作开始时填充了时间缓存，所有超时都相对同一个当前时间，结束时清除
+    int64_t batch_top_key;//批量操作开始时小根堆堆顶的超时时间，堆为空时为INT64_MAX
 
     //子线程通知主线程相关的变量
-    int is_notify_pending;//为1：如果base中存在未决的通知，不再提示
     int th_notify_fd[2];//类似pipe
     struct event th_notify;//th_notify通知主线程的事件
     int (*th_notify_fn)(struct event_base *base);//唤醒主线程的回调
+
+    /* 以下字段会被其它线程写 */
+    char pad_shared[EVENT_CACHELINE];
+    int is_notify_pending;//为1：如果base中存在未决的通知，不再提示
+    char pad_notify[EVENT_CACHELINE - sizeof(int)];
+
+    /** 延迟回调函数的链表，事件循环每次成功处理完一个活动队列中的所有事件之后，调用一次延迟回调函数 */
+    struct deferred_cb_queue defer_queue;
+    char pad_defer[EVENT_CACHELINE];
+
+    struct event_post_queue post_queue;/* event_base_post投递的任务 */
 };
 
 struct event_config_entry {
@@ -156,6 +257,14 @@ struct event_config {
     int n_cpus_hint;      //指明CPU的数量 Windows IOCP使用
     enum event_method_feature require_features;
     enum event_base_config_flag flags;
+
+    int max_dispatch_callbacks;//一轮事件循环最多执行的回调数，0表示不限制
+    struct timeval busy_poll;//忙轮询的自旋时间，为0时不忙轮询
+    int use_timer_wheel;//是否使用时间轮
+    struct timeval timer_wheel_tick;//时间轮精度
+    int clock_source;//时钟源，enum event_clock_source
+    int object_pool_max;//对象池每种对象最多缓存的个数，0表示不使用对象池
+    int max_deferred_callbacks;//一轮事件循环最多执行的延迟回调数，0表示根据队列深度自适应
 };
 
 //事件只处理一次
@@ -166,10 +275,18 @@ struct event_once {
     void *arg;
 };
 
-#define N_ACTIVE_CALLBACKS(base)	((base)->event_count_active + (base)->defer_queue.active_count)
+#define N_ACTIVE_CALLBACKS(base)	((base)->event_count_active + __atomic_load_n(&(base)->defer_queue.active_count, __ATOMIC_RELAXED))
 
 int event_add_nolock(struct event *ev,const struct timeval *tv, int tv_is_absolute);
 int event_del_nolock(struct event *ev);
 void event_active_nolock(struct event *ev, int res, short count);
 
+/*
+ * 从base的对象池中分配/回收kind类型、size大小的对象，内容未初始化；没有开启对象池或者base为NULL时直接使用mm_malloc/mm_free
+ * 回收时base必须还没有释放
+ */
+void *event_base_pool_get_(struct event_base *base, int kind, size_t size);
+void event_base_pool_put_(struct event_base *base, int kind, void *p, size_t size);
+#define event_base_pool_enabled_(base) ((base) && (base)->pools[0].max_free)
+
 #endif //TNET_EVENT_INTERNAL_H
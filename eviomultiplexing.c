@@ -1,5 +1,8 @@
 #include "eviomultiplexing.h"
 #include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
 #include <signal.h>
 #include "event2/thread.h"
 
@@ -512,7 +515,7 @@ int epoll_apply_one_change(struct event_base *base, struct epollop *epollop, con
         return 0;
 
     memset(&epev,0, sizeof(epev));
-    epev.data.fd = ch->fd;
+    epev.data.fd = ch->fd;//fd就是io map的下标，dispatch时直接定位到内联的evmap_io
     epev.events = events;
 
     if(epoll_ctl(epollop->epfd,op,ch->fd,&epev) == 0){
@@ -563,6 +566,43 @@ int epoll_apply_one_change(struct event_base *base, struct epollop *epollop, con
     return -1;
 }
 
+//glibc 2.35之前没有epoll_pwait2的封装，直接使用系统调用
+static int epoll_pwait2_(int epfd, struct epoll_event *events, int maxevents, const struct timespec *ts)
+{
+#ifdef SYS_epoll_pwait2
+    return (int)syscall(SYS_epoll_pwait2, epfd, events, maxevents, ts, NULL, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+//设置精确定时器：优先使用epoll_pwait2，否则创建timerfd并加入epoll
+static void epoll_init_precise_timer(struct epollop *epollop)
+{
+    struct timespec ts = {0, 0};
+    struct epoll_event epev;
+
+    if (epoll_pwait2_(epollop->epfd, epollop->events, epollop->nevents, &ts) >= 0) {
+        epollop->use_pwait2 = 1;
+        return;
+    }
+
+    if ((epollop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC)) < 0) {
+        if (errno != EINVAL && errno != ENOSYS)
+            event_warn("timerfd_create");
+        return;
+    }
+    memset(&epev, 0, sizeof(epev));
+    epev.data.fd = epollop->timerfd;
+    epev.events = EPOLLIN;
+    if (epoll_ctl(epollop->epfd, EPOLL_CTL_ADD, epollop->timerfd, &epev) < 0) {
+        event_warn("epoll_ctl(timerfd)");
+        close(epollop->timerfd);
+        epollop->timerfd = -1;
+    }
+}
+
 void *epoll_init(struct event_base *base)
 {
     int epfd = -1;
@@ -590,6 +630,18 @@ void *epoll_init(struct event_base *base)
         return (NULL);
     }
     epollop->nevents = INITIAL_NEVENT;
+    epollop->timerfd = -1;
+
+    if ((base->flags & EVENT_BASE_FLAG_PRECISE_TIMER) != 0 ||
+        ((base->flags & EVENT_BASE_FLAG_IGNORE_ENV) == 0 && evutil_getenv("EVENT_PRECISE_TIMER") != NULL))
+        epoll_init_precise_timer(epollop);
+
+#ifndef TNET_SINGLE_THREAD
+    //单线程构建直接调用epoll_add/epoll_del，不支持changelist
+    if ((base->flags & EVENT_BASE_FLAG_EPOLL_USE_CHANGELIST) != 0 ||
+        ((base->flags & EVENT_BASE_FLAG_IGNORE_ENV) == 0 && evutil_getenv("EVENT_EPOLL_USE_CHANGELIST") != NULL))
+        base->evsel = &epollops_changelist;
+#endif
 
     evsig_init(base);
 
@@ -624,23 +676,71 @@ int epoll_del(struct event_base *base, int fd, short old, short events, void *p)
     return epoll_apply_one_change(base, (struct epollop *)base->evbase, &ch);
 }
 
+//提交changelist中记录的所有改动，每个fd至多一次epoll_ctl
+static int epoll_apply_changes(struct event_base *base)
+{
+    struct event_changelist *changelist = &base->changelist;
+    struct epollop *epollop = (struct epollop *)base->evbase;
+    int r = 0;
+
+    for (int i = 0; i < changelist->n_changes; ++i) {
+        if (epoll_apply_one_change(base, epollop, &changelist->changes[i]) < 0)
+            r = -1;
+    }
+
+    return (r);
+}
+
 int epoll_dispatch(struct event_base *base, struct timeval *tv)
 {
     struct epollop *epollop = (struct epollop *)base->evbase;
     struct epoll_event *events = epollop->events;
     int  res;
     long timeout = -1;
+    struct timespec ts, *tsp = NULL;
 
-    if (tv != NULL) {
+    if (epollop->use_pwait2) {
+        if (tv != NULL) {
+            ts.tv_sec = tv->tv_sec;
+            ts.tv_nsec = tv->tv_usec * 1000;
+            tsp = &ts;
+        }
+    } else if (epollop->timerfd >= 0) {
+        struct itimerspec is;
+        memset(&is, 0, sizeof(is));
+        if (tv != NULL && tv->tv_sec == 0 && tv->tv_usec == 0) {
+            //timerfd不能表示立即超时，直接轮询，已设置的timerfd留到下次重设
+            timeout = 0;
+        } else if (tv != NULL) {
+            is.it_value.tv_sec = tv->tv_sec;
+            is.it_value.tv_nsec = tv->tv_usec * 1000;
+            if (timerfd_settime(epollop->timerfd, 0, &is, NULL) < 0)
+                event_warn("timerfd_settime");
+            epollop->timerfd_armed = 1;
+        } else if (epollop->timerfd_armed) {
+            //没有超时，取消timerfd，同时清除已触发的状态，否则水平触发会一直返回
+            if (timerfd_settime(epollop->timerfd, 0, &is, NULL) < 0)
+                event_warn("timerfd_settime");
+            epollop->timerfd_armed = 0;
+        }
+    } else if (tv != NULL) {
         timeout = evutil_tv_to_msec(tv);//设置正确的超时值
         if (timeout < 0 || timeout > MAX_EPOLL_TIMEOUT_MSEC) {
             timeout = MAX_EPOLL_TIMEOUT_MSEC;
         }
     }
 
+    if (base->evsel == &epollops_changelist) {
+        epoll_apply_changes(base);
+        event_changelist_remove_all(&base->changelist, base);
+    }
+
     EVBASE_RELEASE_LOCK(base, th_base_lock);
 
-    res = epoll_wait(epollop->epfd, events, epollop->nevents, timeout);
+    if (epollop->use_pwait2)
+        res = epoll_pwait2_(epollop->epfd, events, epollop->nevents, tsp);
+    else
+        res = epoll_wait(epollop->epfd, events, epollop->nevents, timeout);
 
     EVBASE_ACQUIRE_LOCK(base, th_base_lock);
 
@@ -671,7 +771,7 @@ int epoll_dispatch(struct event_base *base, struct timeval *tv)
                 ev |= EV_WRITE;
         }
 
-        if (!ev)
+        if (!ev || events[i].data.fd == epollop->timerfd)
             continue;
 
         evmap_io_active(base, events[i].data.fd, ev | EV_ET);
@@ -701,7 +801,371 @@ void epoll_dealloc(struct event_base *base)
         mm_free(epollop->events);
     if (epollop->epfd >= 0)
         close(epollop->epfd);
+    if (epollop->timerfd >= 0)
+        close(epollop->timerfd);
 
     memset(epollop, 0, sizeof(struct epollop));
     mm_free(epollop);
-}
\ No newline at end of file
+}
+//io_uring相关代码，直接使用系统调用，不依赖liburing
+#define URING_SQ_ENTRIES 256
+#define URING_CQ_ENTRIES 4096
+#define URING_UD_IGNORE  (~(uint64_t)0)//POLL_REMOVE本身的完成事件，忽略
+#define URING_UD(fd, gen) (((uint64_t)(gen) << 32) | (uint32_t)(fd))
+
+static int uring_setup_(unsigned entries, struct io_uring_params *p)
+{
+#ifdef SYS_io_uring_setup
+    return (int)syscall(SYS_io_uring_setup, entries, p);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int uring_enter_(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+#ifdef SYS_io_uring_enter
+    return (int)syscall(SYS_io_uring_enter, ring_fd, to_submit, min_complete, flags, arg, argsz);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static void uring_free_rings(struct uringop *uop)
+{
+    if (uop->sqes)
+        munmap(uop->sqes, uop->sqes_sz);
+    if (uop->cq_ring && uop->cq_ring != uop->sq_ring)
+        munmap(uop->cq_ring, uop->cq_ring_sz);
+    if (uop->sq_ring)
+        munmap(uop->sq_ring, uop->sq_ring_sz);
+    if (uop->ring_fd >= 0)
+        close(uop->ring_fd);
+    if (uop->dirty)
+        mm_free(uop->dirty);
+    if (uop->dirty_spare)
+        mm_free(uop->dirty_spare);
+}
+
+void *uring_init(struct event_base *base)
+{
+    struct io_uring_params p;
+    struct uringop *uop;
+
+    if (!(uop = (struct uringop *)mm_calloc(1, sizeof(struct uringop))))
+        return NULL;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = URING_CQ_ENTRIES;
+    if ((uop->ring_fd = uring_setup_(URING_SQ_ENTRIES, &p)) < 0) {
+        //内核不支持或者被禁用（seccomp等），使用下一个后端
+        if (errno != ENOSYS && errno != EPERM && errno != EACCES)
+            event_warn("io_uring_setup");
+        mm_free(uop);
+        return NULL;
+    }
+    (void)fcntl(uop->ring_fd, F_SETFD, FD_CLOEXEC);
+
+    //需要在io_uring_enter中直接传超时时间（5.11），以及完成队列满时不丢弃完成事件
+    if ((p.features & (IORING_FEAT_EXT_ARG|IORING_FEAT_NODROP)) != (IORING_FEAT_EXT_ARG|IORING_FEAT_NODROP)) {
+        event_debug(("%s: io_uring lacks EXT_ARG or NODROP", __func__));
+        goto err;
+    }
+
+    uop->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    uop->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (uop->cq_ring_sz > uop->sq_ring_sz)
+            uop->sq_ring_sz = uop->cq_ring_sz;
+        uop->cq_ring_sz = uop->sq_ring_sz;
+    }
+    uop->sq_ring = mmap(NULL, uop->sq_ring_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                        uop->ring_fd, IORING_OFF_SQ_RING);
+    if (uop->sq_ring == MAP_FAILED) {
+        uop->sq_ring = NULL;
+        event_warn("mmap(io_uring sq)");
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        uop->cq_ring = uop->sq_ring;
+    } else {
+        uop->cq_ring = mmap(NULL, uop->cq_ring_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                            uop->ring_fd, IORING_OFF_CQ_RING);
+        if (uop->cq_ring == MAP_FAILED) {
+            uop->cq_ring = NULL;
+            event_warn("mmap(io_uring cq)");
+            goto err;
+        }
+    }
+    uop->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    uop->sqes = (struct io_uring_sqe *)mmap(NULL, uop->sqes_sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+                                            uop->ring_fd, IORING_OFF_SQES);
+    if (uop->sqes == MAP_FAILED) {
+        uop->sqes = NULL;
+        event_warn("mmap(io_uring sqes)");
+        goto err;
+    }
+
+    uop->sq_head = (unsigned *)((char *)uop->sq_ring + p.sq_off.head);
+    uop->sq_tail = (unsigned *)((char *)uop->sq_ring + p.sq_off.tail);
+    uop->sq_mask = (unsigned *)((char *)uop->sq_ring + p.sq_off.ring_mask);
+    uop->sq_array = (unsigned *)((char *)uop->sq_ring + p.sq_off.array);
+    uop->sq_entries = p.sq_entries;
+    uop->sq_local_tail = *uop->sq_tail;
+    uop->cq_head = (unsigned *)((char *)uop->cq_ring + p.cq_off.head);
+    uop->cq_tail = (unsigned *)((char *)uop->cq_ring + p.cq_off.tail);
+    uop->cq_mask = (unsigned *)((char *)uop->cq_ring + p.cq_off.ring_mask);
+    uop->cqes = (struct io_uring_cqe *)((char *)uop->cq_ring + p.cq_off.cqes);
+
+    evsig_init(base);
+
+    return uop;
+err:
+    uring_free_rings(uop);
+    mm_free(uop);
+    return NULL;
+}
+
+//提交已经填写的SQE，并按min_complete/flags/arg等待完成事件
+static int uring_enter(struct uringop *uop, unsigned min_complete, unsigned flags, void *arg, size_t argsz)
+{
+    unsigned to_submit = uop->sq_local_tail - __atomic_load_n(uop->sq_head, __ATOMIC_ACQUIRE);
+    int r;
+
+    __atomic_store_n(uop->sq_tail, uop->sq_local_tail, __ATOMIC_RELEASE);
+    if (!to_submit && !(flags & IORING_ENTER_GETEVENTS))
+        return 0;
+    r = uring_enter_(uop->ring_fd, to_submit, min_complete, flags, arg, argsz);
+    if (r < 0 && errno != ETIME && errno != EINTR) {
+        //EBUSY/EAGAIN：完成队列积压，收割之后再提交
+        if (errno != EBUSY && errno != EAGAIN)
+            event_warn("io_uring_enter");
+        return -1;
+    }
+    return 0;
+}
+
+static void uring_reap(struct event_base *base, struct uringop *uop);
+
+//获取一个空闲的SQE，SQ环满时先提交
+static struct io_uring_sqe *uring_get_sqe(struct event_base *base, struct uringop *uop)
+{
+    struct io_uring_sqe *sqe;
+
+    while (uop->sq_local_tail - __atomic_load_n(uop->sq_head, __ATOMIC_ACQUIRE) >= uop->sq_entries) {
+        if (uring_enter(uop, 0, 0, NULL, 0) < 0) {
+            if (errno != EBUSY && errno != EAGAIN)
+                return NULL;
+            uring_reap(base, uop);
+        }
+    }
+    unsigned idx = uop->sq_local_tail & *uop->sq_mask;
+    sqe = &uop->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    uop->sq_array[idx] = idx;
+    ++uop->sq_local_tail;
+    return sqe;
+}
+
+static int uring_mark_dirty(struct uringop *uop, int fd, struct uring_fdinfo *fdinfo)
+{
+    if (fdinfo->dirty)
+        return 0;
+    if (uop->ndirty == uop->dirty_size) {
+        int new_size = uop->dirty_size ? uop->dirty_size * 2 : 64;
+        int *new_dirty = (int *)mm_realloc(uop->dirty, new_size * sizeof(int));
+        if (new_dirty == NULL)
+            return -1;
+        uop->dirty = new_dirty;
+        uop->dirty_size = new_size;
+    }
+    uop->dirty[uop->ndirty++] = fd;
+    fdinfo->dirty = 1;
+    return 0;
+}
+
+int uring_add(struct event_base *base, int fd, short old, short events, void *p)
+{
+    struct uring_fdinfo *fdinfo = (struct uring_fdinfo *)p;
+    fdinfo->want = (old | events) & (EV_READ|EV_WRITE);
+    return uring_mark_dirty((struct uringop *)base->evbase, fd, fdinfo);
+}
+
+int uring_del(struct event_base *base, int fd, short old, short events, void *p)
+{
+    struct uringop *uop = (struct uringop *)base->evbase;
+    struct uring_fdinfo *fdinfo = (struct uring_fdinfo *)p;
+    fdinfo->want = old & ~events & (EV_READ|EV_WRITE);
+
+    //fd上不再有事件时马上取消POLL_ADD：调用者接下来很可能关闭fd，POLL_ADD持有的文件引用会推迟真正的关闭，
+    //而且复用了这个fd号的新连接在下一次dispatch前add时want与armed相同，不会重新提交
+    if (!fdinfo->want && fdinfo->armed) {
+        if (uop->sq_local_tail - __atomic_load_n(uop->sq_head, __ATOMIC_ACQUIRE) < uop->sq_entries) {
+            struct io_uring_sqe *sqe = uring_get_sqe(base, uop);
+            sqe->opcode = IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = URING_UD(fd, fdinfo->gen);
+            sqe->user_data = URING_UD_IGNORE;
+            ++fdinfo->gen;
+            fdinfo->armed = 0;
+            fdinfo->stale = 0;
+            uring_enter(uop, 0, 0, NULL, 0);//失败时SQE留在环中，随下一次io_uring_enter提交
+            return 0;
+        }
+        //SQ环满（这里不能收割），交给dispatch先取消再重新提交
+        fdinfo->stale = 1;
+    }
+    return uring_mark_dirty(uop, fd, fdinfo);
+}
+
+//让fd上提交给内核的POLL_ADD与want一致
+static int uring_sync_fd(struct event_base *base, struct uringop *uop, int fd, struct uring_fdinfo *fdinfo)
+{
+    struct io_uring_sqe *sqe;
+
+    if (fdinfo->armed == fdinfo->want && !fdinfo->stale)
+        return 0;
+    fdinfo->stale = 0;
+
+    if (fdinfo->armed) {
+        if ((sqe = uring_get_sqe(base, uop)) == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = URING_UD(fd, fdinfo->gen);
+        sqe->user_data = URING_UD_IGNORE;
+        ++fdinfo->gen;//被取消的POLL_ADD的完成事件带着旧的代数，收割时丢弃
+        fdinfo->armed = 0;
+    }
+
+    if (fdinfo->want) {
+        if ((sqe = uring_get_sqe(base, uop)) == NULL)
+            return -1;
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = ((fdinfo->want & EV_READ) ? POLLIN : 0) | ((fdinfo->want & EV_WRITE) ? POLLOUT : 0);
+        sqe->user_data = URING_UD(fd, fdinfo->gen);
+        fdinfo->armed = fdinfo->want;
+    }
+    return 0;
+}
+
+static void uring_reap(struct event_base *base, struct uringop *uop)
+{
+    unsigned head = *uop->cq_head;
+    unsigned tail = __atomic_load_n(uop->cq_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        struct io_uring_cqe *cqe = &uop->cqes[head & *uop->cq_mask];
+        uint64_t ud = cqe->user_data;
+        int fd = (int)(uint32_t)ud;
+        struct uring_fdinfo *fdinfo;
+        short ev = 0;
+
+        if (ud == URING_UD_IGNORE || fd < 0 || fd >= base->io.nentries)
+            continue;
+        fdinfo = (struct uring_fdinfo *)evmap_io_get_fdinfo(&base->io, fd);
+        if (fdinfo == NULL || fdinfo->gen != (uint32_t)(ud >> 32) || !fdinfo->armed)
+            continue;
+
+        //一次性的POLL_ADD已经结束，下一次dispatch时如果仍然需要就重新提交
+        fdinfo->armed = 0;
+        ++fdinfo->gen;
+        uring_mark_dirty(uop, fd, fdinfo);
+        if (fdinfo->stale) {
+            //监听的可能是已经关闭的旧文件，结果不属于现在的fd
+            fdinfo->stale = 0;
+            continue;
+        }
+
+        if (cqe->res < 0) {
+            if (cqe->res == -ECANCELED)
+                continue;
+            ev = EV_READ | EV_WRITE;//fd出错，让回调去发现错误
+        } else if (cqe->res & (POLLHUP|POLLERR)) {
+            ev = EV_READ | EV_WRITE;
+        } else {
+            if (cqe->res & POLLIN)
+                ev |= EV_READ;
+            if (cqe->res & POLLOUT)
+                ev |= EV_WRITE;
+        }
+        if (ev)
+            evmap_io_active(base, fd, ev);
+    }
+
+    __atomic_store_n(uop->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int uring_dispatch(struct event_base *base, struct timeval *tv)
+{
+    struct uringop *uop = (struct uringop *)base->evbase;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = 0, min_complete = 0;
+    int res;
+
+    //把这一轮的所有改动和重新监听合并到下面的一次io_uring_enter中。
+    //SQ环满时uring_get_sqe会收割完成事件并重新标记fd，所以先把dirty换到一边再遍历，新标记的fd在下一遍处理
+    while (uop->ndirty) {
+        int *dirty = uop->dirty, ndirty = uop->ndirty, dirty_size = uop->dirty_size;
+        uop->dirty = uop->dirty_spare;
+        uop->dirty_size = uop->dirty_spare_size;
+        uop->ndirty = 0;
+        for (int i = 0; i < ndirty; ++i) {
+            int fd = dirty[i];
+            struct uring_fdinfo *fdinfo;
+            if (fd >= base->io.nentries)
+                continue;
+            fdinfo = (struct uring_fdinfo *)evmap_io_get_fdinfo(&base->io, fd);
+            if (fdinfo == NULL)
+                continue;
+            fdinfo->dirty = 0;
+            if (uring_sync_fd(base, uop, fd, fdinfo) < 0)
+                event_warnx("%s: unable to update io_uring interest on fd %d", __func__, fd);
+        }
+        uop->dirty_spare = dirty;
+        uop->dirty_spare_size = dirty_size;
+    }
+
+    //已经有完成事件、遍历中收割时激活了事件，或者超时为0时不等待
+    if (__atomic_load_n(uop->cq_tail, __ATOMIC_ACQUIRE) == *uop->cq_head &&
+        !base->event_count_active &&
+        (tv == NULL || tv->tv_sec || tv->tv_usec)) {
+        memset(&arg, 0, sizeof(arg));
+        if (tv != NULL) {
+            ts.tv_sec = tv->tv_sec;
+            ts.tv_nsec = tv->tv_usec * 1000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        min_complete = 1;
+    }
+
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+
+    res = uring_enter(uop, min_complete, flags, flags ? &arg : NULL, flags ? sizeof(arg) : 0);
+
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+
+    if (res < 0 && errno != EBUSY && errno != EAGAIN)
+        return -1;
+
+    uring_reap(base, uop);
+
+    return 0;
+}
+
+void uring_dealloc(struct event_base *base)
+{
+    struct uringop *uop = (struct uringop *)base->evbase;
+
+    evsig_dealloc(base);
+    uring_free_rings(uop);
+
+    memset(uop, 0, sizeof(struct uringop));
+    mm_free(uop);
+}
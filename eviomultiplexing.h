@@ -1,5 +1,5 @@
 //
-// Linux 下常见三种IO复用：select poll epoll，默认使用epoll
+// Linux 下的IO复用：io_uring select poll epoll，默认使用epoll，避开epoll（event_config_avoid_method）时使用io_uring
 //
 
 #ifndef TNET_EVIOMULTIPLEXING_H
@@ -8,6 +8,7 @@
 #include <sys/select.h>
 #include <sys/poll.h>
 #include <sys/epoll.h>
+#include <linux/io_uring.h>
 #include <sys/resource.h>
 #include <stdint.h>
 #include "evmemory.h"
@@ -101,6 +102,9 @@ struct epollop {
     struct epoll_event *events;
     int nevents;
     int epfd;
+    int use_pwait2;//EVENT_BASE_FLAG_PRECISE_TIMER：内核支持epoll_pwait2，使用纳秒精度的超时
+    int timerfd;//EVENT_BASE_FLAG_PRECISE_TIMER：不支持epoll_pwait2时加入epoll的timerfd，否则为-1
+    int timerfd_armed;//timerfd是否可能处于设置或者已触发状态
 };
 
 void *epoll_init(struct event_base *);
@@ -121,4 +125,68 @@ const struct eventop epollops = {
         0
 };
 
+//changelist模式：add/del只记录改动，在epoll_dispatch调用epoll_wait之前统一提交
+const struct eventop epollops_changelist = {
+        "epoll (with changelist)",
+        epoll_init,
+        event_changelist_add,
+        event_changelist_del,
+        epoll_dispatch,
+        epoll_dealloc,
+        1, /* need reinit */
+        EV_FEATURE_ET|EV_FEATURE_O1,
+        sizeof(struct event_changelist_fdinfo)
+};
+
+//io_uring相关代码：用一次性的IORING_OP_POLL_ADD监听fd，触发后在下一次dispatch中重新提交
+//fd在evmap中的fdinfo
+struct uring_fdinfo {
+    short want;//当前需要监听的事件，EV_READ|EV_WRITE
+    short armed;//已经提交给内核的POLL_ADD监听的事件，0表示没有
+    uint32_t gen;//POLL_ADD的代数，放在user_data的高32位，用来丢弃被取消或者过期的完成事件
+    int dirty;//是否在uringop的dirty中，等待下一次dispatch同步
+    int stale;//want降为0时没能立即取消旧的POLL_ADD：fd可能已经关闭并被复用，同步时必须取消后重新提交
+};
+
+struct uringop {
+    int ring_fd;
+
+    void *sq_ring;//SQ环的映射，IORING_FEAT_SINGLE_MMAP时CQ环共享这块映射
+    size_t sq_ring_sz;
+    void *cq_ring;
+    size_t cq_ring_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries;
+    unsigned sq_local_tail;//已经填写但还没有提交的SQE的尾部
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    int *dirty;//want和armed可能不一致的fd，在dispatch中合并成一次io_uring_enter提交
+    int ndirty;
+    int dirty_size;
+    int *dirty_spare;//dispatch遍历dirty时与之交换，遍历中收割完成事件重新标记的fd记录到这里，不会覆盖未遍历的项
+    int dirty_spare_size;
+};
+
+void *uring_init(struct event_base *);
+int uring_add(struct event_base *, int fd, short old, short events, void *fdinfo);
+int uring_del(struct event_base *, int fd, short old, short events, void *fdinfo);
+int uring_dispatch(struct event_base *, struct timeval *);
+void uring_dealloc(struct event_base *);
+
+const struct eventop uringops = {
+        "io_uring",
+        uring_init,
+        uring_add,
+        uring_del,
+        uring_dispatch,
+        uring_dealloc,
+        1, /* 需要重新初始化：fork之后子进程不能继续使用父进程的环 */
+        EV_FEATURE_O1|EV_FEATURE_FDS,
+        sizeof(struct uring_fdinfo),
+};
+
 #endif //TNET_EVIOMULTIPLEXING_H
@@ -42,10 +42,8 @@ struct evmap_signal {
 	} while (0)
 
 
-#define GET_IO_SLOT(x,map,slot,type) GET_SIGNAL_SLOT(x,map,slot,type)
-
-#define GET_IO_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)	\
-	GET_SIGNAL_SLOT_AND_CTOR(x,map,slot,type,ctor,fdinfo_len)
+//io map的项内联存放在连续数组中，第slot项直接按下标计算地址，无边界检查
+#define GET_IO_SLOT(x,map,slot,type) (x) = (struct type *)((map)->entries + (size_t)(slot) * (map)->entry_size)
 
 /*  扩展map的大下，直到它足够存储槽slot所在的数据，倍增法，msize表示结构体中entry的内存大小*/
 static int evmap_make_space(struct event_signal_map *map, int slot, int msize)
@@ -72,12 +70,19 @@ static int evmap_make_space(struct event_signal_map *map, int slot, int msize)
 
 void evmap_io_initmap(struct event_io_map* ctx)
 {
-    evmap_signal_initmap(ctx);
+    ctx->nentries = 0;
+    ctx->entry_size = 0;
+    ctx->entries = NULL;
 }
 
 void evmap_io_clear(struct event_io_map* ctx)
 {
-    evmap_signal_clear(ctx);
+    if (ctx->entries != NULL) {
+        mm_free(ctx->entries);
+        ctx->entries = NULL;
+    }
+    ctx->nentries = 0;
+    ctx->entry_size = 0;
 }
 
 /** 结构体evmap_io初始化 */
@@ -88,6 +93,49 @@ static void evmap_io_init(struct evmap_io *entry)
     entry->nwrite = 0;
 }
 
+/*
+ * 扩展io map直到能存放槽slot，倍增法，新增的项全部初始化，fdinfo清零
+ * 数组整体移动后，每一项events队列中指回队列头的指针（空队列的tqh_last、第一个事件的tqe_prev）都要修正
+ */
+static int evmap_io_make_space(struct event_io_map *map, int slot, size_t fdinfo_len)
+{
+    if (map->nentries <= slot) {
+        int nentries = map->nentries ? map->nentries : 32;
+        struct evmap_io *ctx;
+        struct event *first;
+        char *tmp;
+
+        if (map->entry_size == 0)
+            map->entry_size = (int)((sizeof(struct evmap_io) + fdinfo_len + 7) & ~(size_t)7);
+
+        while (nentries <= slot)
+            nentries <<= 1;
+
+        tmp = (char *)mm_realloc(map->entries, (size_t)nentries * map->entry_size);
+        if (tmp == NULL)
+            return (-1);
+        map->entries = tmp;
+
+        for (int i = 0; i < map->nentries; ++i) {
+            GET_IO_SLOT(ctx, map, i, evmap_io);
+            if ((first = TAILQ_FIRST(&ctx->events)) != NULL)
+                first->EV_IO_NEXT.tqe_prev = &ctx->events.tqh_first;
+            else
+                ctx->events.tqh_last = &ctx->events.tqh_first;
+        }
+
+        memset(tmp + (size_t)map->nentries * map->entry_size, 0, (size_t)(nentries - map->nentries) * map->entry_size);
+        for (int i = map->nentries; i < nentries; ++i) {
+            GET_IO_SLOT(ctx, map, i, evmap_io);
+            evmap_io_init(ctx);
+        }
+
+        map->nentries = nentries;
+    }
+
+    return (0);
+}
+
 //有错误发生时返回-1，如果事件后端没有发生任何改变，成功返回0，有处理并且成功返回1
 int evmap_io_add(struct event_base *base, int fd, struct event *ev)
 {
@@ -104,11 +152,11 @@ int evmap_io_add(struct event_base *base, int fd, struct event *ev)
         return 0;
 
     if (fd >= io->nentries) {
-        if (evmap_make_space(io, fd, sizeof(struct evmap_io *)) == -1)
+        if (evmap_io_make_space(io, fd, evsel->fdinfo_len) == -1)
             return (-1);
     }
 
-    GET_IO_SLOT_AND_CTOR(ctx, io, fd, evmap_io, evmap_io_init, evsel->fdinfo_len);
+    GET_IO_SLOT(ctx, io, fd, evmap_io);
 
     nread = ctx->nread;
     nwrite = ctx->nwrite;
@@ -143,7 +191,7 @@ int evmap_io_add(struct event_base *base, int fd, struct event *ev)
     if (res) {
         void *extra = ((char*)ctx) + sizeof(struct evmap_io);
         //不能混用ET和LT
-        if (evsel->add(base, ev->ev_fd, old, (ev->ev_events & EV_ET) | res, extra) == -1)
+        if (EVSEL_ADD(base, ev->ev_fd, old, (ev->ev_events & EV_ET) | res, extra) == -1)
             return (-1);
         retval = 1;
     }
@@ -158,7 +206,6 @@ int evmap_io_add(struct event_base *base, int fd, struct event *ev)
 //有错误发生时返回-1，如果事件后端没有发生任何改变，成功返回0，有处理并且成功返回1
 int evmap_io_del(struct event_base *base, int fd, struct event *ev)
 {
-    const struct eventop *evsel = base->evsel;
     struct event_io_map *io = &base->io;
     struct evmap_io *ctx;
     int nread, nwrite, retval = 0;
@@ -195,7 +242,7 @@ int evmap_io_del(struct event_base *base, int fd, struct event *ev)
 
     if (res) {
         void *extra = ((char*)ctx) + sizeof(struct evmap_io);
-        if (evsel->del(base, ev->ev_fd, old, res, extra) == -1)
+        if (EVSEL_DEL(base, ev->ev_fd, old, res, extra) == -1)
             return -1;
         retval = 1;
     }
@@ -218,8 +265,6 @@ void evmap_io_active(struct event_base *base, int fd, short events)
 
     GET_IO_SLOT(ctx, io, fd, evmap_io);
 
-    if (NULL == ctx)
-        return;
     TAILQ_FOREACH(ev, &ctx->events, EV_IO_NEXT) {
         if (ev->ev_events & events)
             event_active_nolock(ev, ev->ev_events & events, 1);
@@ -229,11 +274,10 @@ void evmap_io_active(struct event_base *base, int fd, short events)
 void *evmap_io_get_fdinfo(struct event_io_map *map, int fd)
 {
     struct evmap_io *ctx;
-    GET_IO_SLOT(ctx, map, fd, evmap_io);
-    if (ctx)
-        return ((char*)ctx) + sizeof(struct evmap_io);
-    else
+    if (fd < 0 || fd >= map->nentries)
         return NULL;
+    GET_IO_SLOT(ctx, map, fd, evmap_io);
+    return ((char*)ctx) + sizeof(struct evmap_io);
 }
 
 void evmap_signal_initmap(struct event_signal_map *ctx)
@@ -318,4 +362,136 @@ void evmap_signal_active(struct event_base *base, int sig, int ncalls)
         return;
     TAILQ_FOREACH(ev,&ctx->events,EV_SIGNAL_NEXT)
         event_active_nolock(ev, EV_SIGNAL, ncalls);
-}
\ No newline at end of file
+}
+
+void event_changelist_init(struct event_changelist *changelist)
+{
+    changelist->changes = NULL;
+    changelist->changes_size = 0;
+    changelist->n_changes = 0;
+}
+
+//返回fd对应的fdinfo，fd不在evmap中时返回NULL
+static struct event_changelist_fdinfo *event_change_get_fdinfo(struct event_base *base, const struct event_change *change)
+{
+    if (change->fd < 0 || change->fd >= base->io.nentries)
+        return NULL;
+    return (struct event_changelist_fdinfo *)evmap_io_get_fdinfo(&base->io, change->fd);
+}
+
+void event_changelist_remove_all(struct event_changelist *changelist, struct event_base *base)
+{
+    for (int i = 0; i < changelist->n_changes; ++i) {
+        struct event_change *ch = &changelist->changes[i];
+        struct event_changelist_fdinfo *fdinfo = event_change_get_fdinfo(base, ch);
+        if (fdinfo) {
+            EVUTIL_ASSERT(fdinfo->idxplus1 == i + 1);
+            fdinfo->idxplus1 = 0;
+        }
+    }
+
+    changelist->n_changes = 0;
+}
+
+void event_changelist_freemem(struct event_changelist *changelist)
+{
+    if (changelist->changes)
+        mm_free(changelist->changes);
+    event_changelist_init(changelist);
+}
+
+//倍增法扩展changes
+static int event_changelist_grow(struct event_changelist *changelist)
+{
+    int new_size;
+    struct event_change *new_changes;
+
+    if (changelist->changes_size < 64)
+        new_size = 64;
+    else
+        new_size = changelist->changes_size * 2;
+
+    new_changes = (struct event_change *)mm_realloc(changelist->changes, new_size * sizeof(struct event_change));
+    if (EVUTIL_UNLIKELY(new_changes == NULL))
+        return (-1);
+
+    changelist->changes = new_changes;
+    changelist->changes_size = new_size;
+
+    return (0);
+}
+
+//返回fd在changelist中的改动项，不存在时新建一项，old_events记录的是第一次改动之前后端中的事件
+static struct event_change *event_changelist_get_or_construct(struct event_changelist *changelist, int fd,
+                                                              short old_events, struct event_changelist_fdinfo *fdinfo)
+{
+    struct event_change *change;
+
+    if (fdinfo->idxplus1 == 0) {
+        int idx;
+        EVUTIL_ASSERT(changelist->n_changes <= changelist->changes_size);
+
+        if (changelist->n_changes == changelist->changes_size) {
+            if (event_changelist_grow(changelist) < 0)
+                return NULL;
+        }
+
+        idx = changelist->n_changes++;
+        change = &changelist->changes[idx];
+        fdinfo->idxplus1 = idx + 1;
+
+        memset(change, 0, sizeof(struct event_change));
+        change->fd = fd;
+        change->old_events = old_events;
+    } else {
+        change = &changelist->changes[fdinfo->idxplus1 - 1];
+        EVUTIL_ASSERT(change->fd == fd);
+    }
+    return change;
+}
+
+int event_changelist_add(struct event_base *base, int fd, short old, short events, void *p)
+{
+    struct event_changelist *changelist = &base->changelist;
+    struct event_changelist_fdinfo *fdinfo = (struct event_changelist_fdinfo *)p;
+    struct event_change *change;
+
+    change = event_changelist_get_or_construct(changelist, fd, old, fdinfo);
+    if (!change)
+        return -1;
+
+    /* 添加会覆盖之前的删除，但不会变成空操作：fd可能在上次添加之后被关闭并重新打开，删除不一定成功 */
+    if (events & (EV_READ|EV_SIGNAL))
+        change->read_change = EV_CHANGE_ADD | (events & (EV_ET|EV_PERSIST|EV_SIGNAL));
+    if (events & EV_WRITE)
+        change->write_change = EV_CHANGE_ADD | (events & (EV_ET|EV_PERSIST|EV_SIGNAL));
+
+    return (0);
+}
+
+int event_changelist_del(struct event_base *base, int fd, short old, short events, void *p)
+{
+    struct event_changelist *changelist = &base->changelist;
+    struct event_changelist_fdinfo *fdinfo = (struct event_changelist_fdinfo *)p;
+    struct event_change *change;
+
+    change = event_changelist_get_or_construct(changelist, fd, old, fdinfo);
+    if (!change)
+        return -1;
+
+    /* 删除一个后端中本来就没有的事件，等于取消之前未提交的添加，结果是空操作；空操作项保留在列表中，提交时直接跳过 */
+    if (events & (EV_READ|EV_SIGNAL)) {
+        if (!(change->old_events & (EV_READ|EV_SIGNAL)))
+            change->read_change = 0;
+        else
+            change->read_change = EV_CHANGE_DEL;
+    }
+    if (events & EV_WRITE) {
+        if (!(change->old_events & EV_WRITE))
+            change->write_change = 0;
+        else
+            change->write_change = EV_CHANGE_DEL;
+    }
+
+    return (0);
+}
@@ -1,5 +1,5 @@
 /*
- * event_io_map其实就是event_signal_map，是用的宏定义，但是event_signal_map中关于IO事件和signal信号量使用的数据结构不同
+ * event_io_map是按fd下标的evmap_io连续数组（fdinfo紧跟在每一项的evmap_io后面），event_signal_map是按信号下标的evmap_signal指针数组
 */
 
 #ifndef TNET_EVMAP_INTERNAL_H
@@ -25,7 +25,7 @@ int evmap_io_del(struct event_base *base, int fd, struct event *ev);
 /* 激活event_base上给定fd的一组事件（EV_READ|EV_WRITE|EV_ET.）*/
 void evmap_io_active(struct event_base *base, int fd, short events);
 
-/* 返回与给定fd关联的fdinfo对象。 如果fd没有与之相关联的事件，则结果可能为NULL.*/
+/* 返回与给定fd关联的fdinfo对象，fd超出io map的范围时返回NULL；从未添加过事件的fd返回清零的fdinfo */
 void *evmap_io_get_fdinfo(struct event_io_map *ctx, int fd);
 
 /* 这些函数的作用与evmap_io_ *的方式相同，除了它们处理信号而不是fds。*/
@@ -33,4 +33,13 @@ int evmap_signal_add(struct event_base *base, int signum, struct event *ev);
 int evmap_signal_del(struct event_base *base, int signum, struct event *ev);
 void evmap_signal_active(struct event_base *base, int signum, int ncalls);
 
+/* changelist相关：初始化、清空所有改动（并重置每个fd的fdinfo）、释放内存 */
+void event_changelist_init(struct event_changelist *changelist);
+void event_changelist_remove_all(struct event_changelist *changelist, struct event_base *base);
+void event_changelist_freemem(struct event_changelist *changelist);
+
+/* 作为后端的add和del使用：只记录并合并改动，不立即提交。fdinfo必须是struct event_changelist_fdinfo */
+int event_changelist_add(struct event_base *base, int fd, short old, short events, void *fdinfo);
+int event_changelist_del(struct event_base *base, int fd, short old, short events, void *fdinfo);
+
 #endif //TNET_EVMAP_INTERNAL_H
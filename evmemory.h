@@ -26,4 +26,52 @@ void event_mm_free(void *ptr);
 #define mm_realloc(ptr, sz) event_mm_realloc((ptr), (sz))
 #define mm_free(ptr) event_mm_free(ptr)
 
+/*
+ * 对象池：缓存释放的固定大小对象，下次分配时直接复用，减少malloc/free和堆碎片
+ * 空闲对象的前sizeof(void *)字节用作链表指针；不加锁，由调用者同步
+ */
+struct mm_pool {
+    void *free_list;
+    size_t size;//对象大小，第一次使用时确定
+    unsigned n_free;//缓存的对象数
+    unsigned max_free;//最多缓存的对象数，0表示不缓存
+};
+
+//从池中取一个size大小的对象，池为空时用mm_malloc分配，内容未初始化
+static inline void *mm_pool_get(struct mm_pool *pool, size_t size)
+{
+    void *p = pool->free_list;
+    if (p && pool->size == size) {
+        pool->free_list = *(void **)p;
+        --pool->n_free;
+        return p;
+    }
+    return mm_malloc(size);
+}
+
+//把mm_malloc分配的size大小的对象放回池中，池满时释放
+static inline void mm_pool_put(struct mm_pool *pool, void *p, size_t size)
+{
+    if (pool->size == 0)
+        pool->size = size;
+    if (pool->n_free >= pool->max_free || pool->size != size) {
+        mm_free(p);
+        return;
+    }
+    *(void **)p = pool->free_list;
+    pool->free_list = p;
+    ++pool->n_free;
+}
+
+//释放池中缓存的所有对象
+static inline void mm_pool_clear(struct mm_pool *pool)
+{
+    void *p;
+    while ((p = pool->free_list)) {
+        pool->free_list = *(void **)p;
+        mm_free(p);
+    }
+    pool->n_free = 0;
+}
+
 #endif //TNET_MM_INTERNAL_H
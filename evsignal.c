@@ -1,6 +1,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/signalfd.h>
 #include "sys/queue.h"
 #include <signal.h>
 #include <stdio.h>
@@ -9,11 +10,13 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include "event2/event.h"
 #include "event2/event_struct.h"
 #include "event_internal.h"
 #include "event2/util.h"
 #include "evsignal.h"
+#include "evutil.h"
 #include "evlog.h"
 #include "evmap.h"
 #include "evthread.h"
@@ -22,10 +25,13 @@
  * 信号处理实现，使用sigaction或者signal来设置事件处理函数，目前linux上普遍支持sigaction，我是采用这种方式
  * 信号事件的处理采用统一事件源的方式
  * 一次只能一个event_base被设置信号
+ * 设置EVENT_BASE_FLAG_USE_SIGNALFD时改用signalfd：每个event_base有自己的signalfd，阻塞信号后由signalfd读出，没有信号处理函数
  */
 
 static int evsig_add(struct event_base *, int , short , short , void *);
 static int evsig_del(struct event_base *, int , short , short , void *);
+static int evsig_signalfd_add(struct event_base *, int , short , short , void *);
+static int evsig_signalfd_del(struct event_base *, int , short , short , void *);
 
 static const struct eventop evsigops = {
         "signal",
@@ -37,6 +43,16 @@ static const struct eventop evsigops = {
         0,0,0
 };
 
+static const struct eventop evsig_signalfd_ops = {
+        "signalfd",
+        NULL,
+        evsig_signalfd_add,
+        evsig_signalfd_del,
+        NULL,
+        NULL,
+        0,0,0
+};
+
 static void *evsig_base_lock = NULL;
 
 static struct event_base *evsig_base = NULL;
@@ -52,6 +68,9 @@ static void evsig_handler(int sig);
 
 //设置全局参数
 void evsig_set_base(struct event_base *base){
+    //signalfd不经过全局的信号处理函数
+    if (base->sig.use_signalfd)
+        return;
     EVSIGBASE_LOCK();
     evsig_base = base;
     evsig_base_n_signals_added = base->sig.ev_n_signals_added;
@@ -96,19 +115,85 @@ static void evsig_cb(int fd, short what, void *arg){
 	EVBASE_RELEASE_LOCK(base, th_base_lock);
 }
 
-int evsig_init(struct event_base *base){
-    /* 我们的信号处理程序将写入双向管道一端以唤醒我们的事件循环。 事件循环然后扫描递送的信号 */
-    if(evutil_make_internal_pipe(base->sig.ev_signal_pair) == -1){
-        event_sock_err(1,-1, "%s: socketpair", __func__);
+//signalfd可读时的回调函数，一次读出一批信号
+static void evsig_signalfd_cb(int fd, short what, void *arg){
+    struct signalfd_siginfo info[16];
+    ssize_t n;
+    int ncaught[NSIG];
+    struct event_base *base;
+
+    base = (struct event_base*)arg;
+
+    memset(&ncaught,0, sizeof(ncaught));
+
+    while(1){
+        n = read(fd, info, sizeof(info));
+        if(n == -1){
+            int err = errno;
+            if(!EVUTIL_ERR_RW_RETRIABLE(err))
+                event_sock_err(1,fd,"%s: read",__func__);
+            break;
+        }
+        for(size_t i = 0; i < n / sizeof(info[0]); ++i){
+            if(info[i].ssi_signo < NSIG)
+                ncaught[info[i].ssi_signo]++;
+        }
+        //没有读满说明已经读完，省掉一次返回EAGAIN的read
+        if((size_t)n < sizeof(info))
+            break;
+    }
+
+    EVBASE_ACQUIRE_LOCK(base, th_base_lock);
+    for (int i = 0;  i < NSIG; ++i) {
+        if(ncaught[i])
+            evmap_signal_active(base, i, ncaught[i]);
+    }
+    EVBASE_RELEASE_LOCK(base, th_base_lock);
+}
+
+//创建不关注任何信号的signalfd，添加信号事件时再修改掩码
+static int evsig_init_signalfd(struct event_base *base){
+    struct evsig_info *sig = &base->sig;
+    int fd;
+
+    sigemptyset(&sig->signalfd_mask);
+    if ((fd = signalfd(-1, &sig->signalfd_mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        event_warn("%s: signalfd", __func__);
         return -1;
     }
+    sig->ev_signal_pair[0] = fd;
+    sig->ev_signal_pair[1] = -1;
+    sig->use_signalfd = 1;
+
+    event_assign(&sig->ev_signal, base, fd, EV_READ | EV_PERSIST, evsig_signalfd_cb, base);
+    sig->ev_signal.ev_flags |= EVLIST_INTERNAL;
+    event_priority_set(&sig->ev_signal, 0);
 
-    if(base->sig.sh_old){
+    base->evsigsel = &evsig_signalfd_ops;
+    return 0;
+}
+
+int evsig_init(struct event_base *base){
+    if (base->sig.sh_old) {
         mm_free(base->sig.sh_old);
     }
     base->sig.sh_old = NULL;
     base->sig.sh_old_max = 0;
 
+    if ((base->flags & EVENT_BASE_FLAG_USE_SIGNALFD) ||
+        ((base->flags & EVENT_BASE_FLAG_IGNORE_ENV) == 0 && evutil_getenv("EVENT_USE_SIGNALFD") != NULL)) {
+        if (evsig_init_signalfd(base) == 0)
+            return 0;
+        event_warnx("%s: signalfd unavailable, falling back to signal handlers", __func__);
+    }
+    base->sig.use_signalfd = 0;
+
+    /* 我们的信号处理程序将写入双向管道一端以唤醒我们的事件循环。 事件循环然后扫描递送的信号 */
+    if(evutil_make_internal_pipe(base->sig.ev_signal_pair) == -1){
+        event_sock_err(1,-1, "%s: socketpair", __func__);
+        return -1;
+    }
+
     event_assign(&base->sig.ev_signal, base, base->sig.ev_signal_pair[0],
                  EV_READ | EV_PERSIST, evsig_cb, base);
 
@@ -246,6 +331,74 @@ static int evsig_del(struct event_base *base, int evsignal, short old, short eve
     return (evsig_restore_handler(base, (int)evsignal));
 }
 
+static int evsig_signalfd_add(struct event_base *base,int evsignal,short old,short events,void *p){
+    struct evsig_info *sig = &base->sig;
+    sigset_t set, oset;
+    int err;
+    (void)p;
+
+    EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+    //阻塞信号，使它留在待处理队列中由signalfd读出；原来没有阻塞的，删除时恢复
+    sigemptyset(&set);
+    sigaddset(&set, evsignal);
+    if ((err = pthread_sigmask(SIG_BLOCK, &set, &oset)) != 0) {
+        event_warnx("%s: pthread_sigmask: %s", __func__, strerror(err));
+        return (-1);
+    }
+    if (!sigismember(&oset, evsignal))
+        sigaddset(&sig->signalfd_blocked, evsignal);
+
+    sigaddset(&sig->signalfd_mask, evsignal);
+    if (signalfd(sig->ev_signal_pair[0], &sig->signalfd_mask, 0) == -1) {
+        event_warn("%s: signalfd", __func__);
+        goto err;
+    }
+
+    if (!sig->ev_signal_added) {
+        if (event_add_nolock(&sig->ev_signal, NULL, 0))
+            goto err;
+        sig->ev_signal_added = 1;
+    }
+    ++sig->ev_n_signals_added;
+
+    return (0);
+
+err:
+    sigdelset(&sig->signalfd_mask, evsignal);
+    signalfd(sig->ev_signal_pair[0], &sig->signalfd_mask, 0);
+    if (sigismember(&sig->signalfd_blocked, evsignal)) {
+        sigdelset(&sig->signalfd_blocked, evsignal);
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    }
+    return (-1);
+}
+
+static int evsig_signalfd_del(struct event_base *base, int evsignal, short old, short events, void *p)
+{
+    struct evsig_info *sig = &base->sig;
+    sigset_t set;
+
+    EVUTIL_ASSERT(evsignal >= 0 && evsignal < NSIG);
+
+    event_debug(("%s: %d: removing signal from signalfd", __func__, evsignal));
+
+    sigdelset(&sig->signalfd_mask, evsignal);
+    if (signalfd(sig->ev_signal_pair[0], &sig->signalfd_mask, 0) == -1)
+        event_warn("%s: signalfd", __func__);
+    --sig->ev_n_signals_added;
+
+    //解除阻塞后，已经到达但还没有读出的信号按原来的处理方式投递
+    if (sigismember(&sig->signalfd_blocked, evsignal)) {
+        sigdelset(&sig->signalfd_blocked, evsignal);
+        sigemptyset(&set);
+        sigaddset(&set, evsignal);
+        pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+    }
+
+    return (0);
+}
+
 static void evsig_handler(int sig)
 {
     int save_errno = errno;
@@ -14,6 +14,11 @@ struct evsig_info {
     //用于恢复旧的信号处理程序，这儿默认使用sigaction，
     struct sigaction **sh_old;
     int sh_old_max;//sh_old的大小
+
+    //EVENT_BASE_FLAG_USE_SIGNALFD：ev_signal_pair[0]为signalfd，ev_signal_pair[1]为-1，不安装信号处理函数
+    int use_signalfd;
+    sigset_t signalfd_mask;//signalfd关注的信号
+    sigset_t signalfd_blocked;//由我们阻塞的信号，删除信号事件时解除阻塞
 };
 
 int evsig_init(struct event_base *);
@@ -32,6 +32,12 @@ struct evthread_condition_callbacks *evthread_get_condition_callbacks() {
 int evthread_set_lock_callbacks(const struct evthread_lock_callbacks *cbs){
     struct evthread_lock_callbacks *target = evthread_get_lock_callbacks();
 
+#ifdef TNET_SINGLE_THREAD
+    if (cbs) {
+        event_warnx("%s: locking is compiled out of the single-threaded build", __func__);
+        return -1;
+    }
+#endif
     //参数为NULL，取消线程锁功能
     if(!cbs){
         if(target->alloc)
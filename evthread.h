@@ -11,6 +11,34 @@ extern struct evthread_condition_callbacks evthread_cond_fns_;
 extern unsigned long (*evthread_id_fn_)(void);
 extern int evthread_lock_debugging_enabled_;
 
+#ifdef TNET_SINGLE_THREAD
+/*
+ * 单线程构建（make libtnet_st.a，定义TNET_SINGLE_THREAD）：锁、条件变量和线程判断在编译期去掉，
+ * 热路径上没有锁指针判断和间接调用。event_base及其上的事件、bufferevent只能在一个线程中使用，
+ * evthread_use_pthreads和evthread_set_lock_callbacks返回-1
+ */
+#define EVTHREAD_GET_ID() 1
+#define EVBASE_IN_THREAD(base) 1
+#define EVBASE_NEED_NOTIFY(base) 0
+#define EVTHREAD_ALLOC_LOCK(lockvar,locktype) ((lockvar) = NULL)
+#define EVTHREAD_FREE_LOCK(lockvar,locktype) do { (void)(lockvar); } while (0)
+#define EVLOCK_LOCK(lockvar,mode) do { (void)(lockvar); } while (0)
+#define EVLOCK_UNLOCK(lockvar,mode) do { (void)(lockvar); } while (0)
+#define EVBASE_ACQUIRE_LOCK(base, lockvar) do { } while (0)
+#define EVBASE_RELEASE_LOCK(base, lockvar) do { } while (0)
+#define EVLOCK_ASSERT_LOCKED(lock) do { } while (0)
+#define EVTHREAD_ALLOC_COND(condvar) do { (condvar) = NULL; } while (0)
+#define EVTHREAD_FREE_COND(cond) do { (void)(cond); } while (0)
+#define EVTHREAD_COND_SIGNAL(cond) ((void)(cond))
+#define EVTHREAD_COND_BROADCAST(cond) ((void)(cond))
+#define EVTHREAD_COND_WAIT(cond, lock) ((void)(cond))
+#define EVTHREAD_COND_WAIT_TIMED(cond, lock, tv) ((void)(cond))
+#define EVTHREAD_LOCKING_ENABLED() 0
+#define EVLOCK_TRY_LOCK_(lock) 1
+#define EVLOCK_LOCK2(lock1,lock2,mode1,mode2) do { } while (0)
+#define EVLOCK_UNLOCK2(lock1,lock2,mode1,mode2) do { } while (0)
+#else
+
 //获取当前线程ID，如果线程不可用，返回1
 #define EVTHREAD_GET_ID() (evthread_id_fn_ ? evthread_id_fn_() : 1)
 
@@ -139,6 +167,7 @@ static inline int EVLOCK_TRY_LOCK_(void *lock) {
 			EVLOCK_UNLOCK(_lock2_tmplock,mode2);		\
 		EVLOCK_UNLOCK(_lock1_tmplock,mode1);			\
 	} while (0)
+#endif //TNET_SINGLE_THREAD
 
 
 int evthread_is_debug_lock_held_(void *lock);
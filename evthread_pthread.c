@@ -123,6 +123,13 @@ int evthread_use_pthreads(){
             evthread_posix_cond_wait
     };
 
+#ifdef TNET_SINGLE_THREAD
+    //单线程构建中锁在编译期去掉，不能开启多线程
+    (void)cbs;
+    (void)cond_cbs;
+    return -1;
+#endif
+
     //设置递归锁的属性
     if(pthread_mutexattr_init(&attr_recursive))return -1;
     if(pthread_mutexattr_settype(&attr_recursive,PTHREAD_MUTEX_RECURSIVE))return -1;
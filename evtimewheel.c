@@ -0,0 +1,262 @@
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdint.h>
+#include <string.h>
+#include "sys/queue.h"
+#include "event2/event_struct.h"
+#include "evtimewheel.h"
+#include "evmemory.h"
+#include "evutil.h"
+
+#define TW_ROOT_MASK  (TIMER_WHEEL_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK (TIMER_WHEEL_LEVEL_SIZE - 1)
+#define TW_NO_TICK    UINT64_MAX
+
+//第level层（从1开始）槽位索引在tick中的起始位
+#define TW_LEVEL_SHIFT(level) (TIMER_WHEEL_ROOT_BITS + ((level) - 1) * TIMER_WHEEL_LEVEL_BITS)
+//时间轮的总跨度（tick数）
+#define TW_SPAN ((uint64_t)1 << TW_LEVEL_SHIFT(TIMER_WHEEL_NLEVELS + 1))
+
+#define TW_NEXT ev_timeout_pos.ev_next_with_timer_wheel
+
+static inline uint64_t tv_to_usec(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+//到期时间向上取整到tick，保证定时器不会提前触发
+static inline uint64_t timer_wheel_expires(const struct timer_wheel *w, const struct event *ev)
+{
+    return (tv_to_usec(&ev->ev_timeout) + w->tick_usec - 1) / w->tick_usec;
+}
+
+//在64位的位图中从pos开始循环查找下一个置位的位，返回距离pos的偏移，没有返回-1
+static inline int bitmap64_next(uint64_t bits, unsigned pos)
+{
+    uint64_t rotated;
+    if (!bits)
+        return -1;
+    rotated = pos ? ((bits >> pos) | (bits << (64 - pos))) : bits;
+    return __builtin_ctzll(rotated);
+}
+
+//在第0层的位图中从pos开始循环查找下一个置位的槽，返回距离pos的偏移，没有返回-1
+static int root_bitmap_next(const uint64_t *bitmap, unsigned pos)
+{
+    const unsigned nwords = TIMER_WHEEL_ROOT_SIZE / 64;
+    unsigned word = pos / 64, bit = pos % 64;
+    uint64_t bits = bitmap[word] & (~(uint64_t)0 << bit);
+
+    for (unsigned i = 0; i <= nwords; ++i) {
+        if (bits) {
+            unsigned slot = ((word + i) % nwords) * 64 + __builtin_ctzll(bits);
+            return (slot - pos) & TW_ROOT_MASK;
+        }
+        bits = bitmap[(word + i + 1) % nwords];
+        if (i + 1 == nwords)//回到起始的字，只看pos之前的位
+            bits &= bit ? ~(~(uint64_t)0 << bit) : 0;
+    }
+    return -1;
+}
+
+static void timer_wheel_place(struct timer_wheel *w, struct event *ev)
+{
+    uint64_t expires = timer_wheel_expires(w, ev);
+    uint64_t delta;
+    int level, slot;
+
+    if (expires < w->current)//已经过期，放到当前槽中
+        expires = w->current;
+    delta = expires - w->current;
+
+    if (delta < TIMER_WHEEL_ROOT_SIZE) {
+        slot = expires & TW_ROOT_MASK;
+        LIST_INSERT_HEAD(&w->root[slot], ev, TW_NEXT);
+        w->root_bitmap[slot / 64] |= (uint64_t)1 << (slot % 64);
+        return;
+    }
+
+    if (delta >= TW_SPAN)//超出时间轮跨度，先放到最远的槽中，级联时重新放置
+        expires = w->current + TW_SPAN - 1;
+
+    for (level = 1; level < TIMER_WHEEL_NLEVELS; ++level) {
+        if (delta < ((uint64_t)1 << TW_LEVEL_SHIFT(level + 1)))
+            break;
+    }
+    slot = (expires >> TW_LEVEL_SHIFT(level)) & TW_LEVEL_MASK;
+    LIST_INSERT_HEAD(&w->levels[level - 1][slot], ev, TW_NEXT);
+    w->level_bitmap[level - 1] |= (uint64_t)1 << slot;
+}
+
+//返回下一个需要处理（触发或者级联）的tick，时间轮为空返回TW_NO_TICK
+static uint64_t timer_wheel_next_tick(struct timer_wheel *w)
+{
+    uint64_t best = TW_NO_TICK;
+    unsigned pos = w->current & TW_ROOT_MASK;
+    int d;
+
+    if (!w->count)
+        return TW_NO_TICK;
+
+    //第0层：包括当前tick
+    while ((d = root_bitmap_next(w->root_bitmap, pos)) >= 0) {
+        unsigned slot = (pos + d) & TW_ROOT_MASK;
+        if (!LIST_EMPTY(&w->root[slot])) {
+            best = w->current + d;
+            break;
+        }
+        w->root_bitmap[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    }
+
+    //高层：当前tick上的级联已经完成，只看之后对齐的tick
+    for (int level = 1; level <= TIMER_WHEEL_NLEVELS; ++level) {
+        unsigned shift = TW_LEVEL_SHIFT(level);
+        uint64_t start = ((w->current >> shift) + 1) << shift;
+        unsigned idx = (start >> shift) & TW_LEVEL_MASK;
+        uint64_t *bitmap = &w->level_bitmap[level - 1];
+
+        if (start >= best)//更高层对齐的tick只会更晚
+            break;
+
+        while ((d = bitmap64_next(*bitmap, idx)) >= 0) {
+            unsigned slot = (idx + d) & TW_LEVEL_MASK;
+            if (!LIST_EMPTY(&w->levels[level - 1][slot])) {
+                uint64_t t = start + ((uint64_t)d << shift);
+                if (t < best)
+                    best = t;
+                break;
+            }
+            *bitmap &= ~((uint64_t)1 << slot);
+        }
+    }
+
+    return best;
+}
+
+//tick t对齐到高层槽的边界时，把对应槽中的定时器重新放置到低层
+static void timer_wheel_cascade(struct timer_wheel *w, uint64_t t)
+{
+    if (t & TW_ROOT_MASK)
+        return;
+
+    for (int level = 1; level <= TIMER_WHEEL_NLEVELS; ++level) {
+        unsigned idx = (t >> TW_LEVEL_SHIFT(level)) & TW_LEVEL_MASK;
+        struct timer_wheel_slot *slot = &w->levels[level - 1][idx];
+        struct event *ev;
+
+        w->level_bitmap[level - 1] &= ~((uint64_t)1 << idx);
+        while ((ev = LIST_FIRST(slot)) != NULL) {
+            LIST_REMOVE(ev, TW_NEXT);
+            timer_wheel_place(w, ev);
+        }
+        if (idx != 0)
+            break;
+    }
+}
+
+struct timer_wheel *timer_wheel_new(const struct timeval *tick, const struct timeval *now)
+{
+    struct timer_wheel *w;
+    uint64_t tick_usec = tv_to_usec(tick);
+
+    if (tick_usec == 0)
+        return NULL;
+    if ((w = (struct timer_wheel *)mm_calloc(1, sizeof(struct timer_wheel))) == NULL)
+        return NULL;
+
+    w->tick_usec = tick_usec;
+    w->current = tv_to_usec(now) / tick_usec;
+    //全零即为空链表
+    return w;
+}
+
+void timer_wheel_free(struct timer_wheel *w)
+{
+    mm_free(w);
+}
+
+void timer_wheel_add(struct timer_wheel *w, struct event *ev)
+{
+    timer_wheel_place(w, ev);
+    ++w->count;
+}
+
+void timer_wheel_del(struct timer_wheel *w, struct event *ev)
+{
+    EVUTIL_ASSERT(w->count > 0);
+    LIST_REMOVE(ev, TW_NEXT);
+    --w->count;
+}
+
+int timer_wheel_next_timeout(struct timer_wheel *w, const struct timeval *now, struct timeval *tv)
+{
+    uint64_t t = timer_wheel_next_tick(w);
+    uint64_t deadline, now_usec;
+
+    if (t == TW_NO_TICK)
+        return -1;
+
+    deadline = t * w->tick_usec;
+    now_usec = tv_to_usec(now);
+    if (deadline <= now_usec) {
+        evutil_timerclear(tv);
+    } else {
+        tv->tv_sec = (deadline - now_usec) / 1000000;
+        tv->tv_usec = (deadline - now_usec) % 1000000;
+    }
+    return 0;
+}
+
+struct event *timer_wheel_first_expired(struct timer_wheel *w, const struct timeval *now)
+{
+    uint64_t now_tick = tv_to_usec(now) / w->tick_usec;
+
+    for (;;) {
+        uint64_t t = timer_wheel_next_tick(w);
+        struct timer_wheel_slot *slot;
+
+        if (t == TW_NO_TICK || t > now_tick) {
+            //now之前没有需要处理的槽，可以直接跳到now，避免空闲后逐个级联
+            if (now_tick > w->current)
+                w->current = now_tick;
+            return NULL;
+        }
+
+        if (t != w->current) {
+            w->current = t;
+            timer_wheel_cascade(w, t);
+        }
+
+        slot = &w->root[w->current & TW_ROOT_MASK];
+        if (!LIST_EMPTY(slot))
+            return LIST_FIRST(slot);
+    }
+}
+
+struct event *timer_wheel_first(struct timer_wheel *w)
+{
+    int d;
+
+    if (!w->count)
+        return NULL;
+
+    while ((d = root_bitmap_next(w->root_bitmap, 0)) >= 0) {
+        if (!LIST_EMPTY(&w->root[d]))
+            return LIST_FIRST(&w->root[d]);
+        w->root_bitmap[d / 64] &= ~((uint64_t)1 << (d % 64));
+    }
+    for (int level = 0; level < TIMER_WHEEL_NLEVELS; ++level) {
+        while ((d = bitmap64_next(w->level_bitmap[level], 0)) >= 0) {
+            if (!LIST_EMPTY(&w->levels[level][d]))
+                return LIST_FIRST(&w->levels[level][d]);
+            w->level_bitmap[level] &= ~((uint64_t)1 << d);
+        }
+    }
+    return NULL;
+}
+
+int timer_wheel_elt_is_first(struct timer_wheel *w, const struct event *ev)
+{
+    uint64_t expires = timer_wheel_expires(w, ev);
+    return expires <= timer_wheel_next_tick(w);
+}
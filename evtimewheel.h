@@ -0,0 +1,57 @@
+//
+// 分层时间轮，作为小根堆之外的另一种定时器实现，插入和删除为O(1)
+// 第0层256个槽，每槽一个tick；第1~3层各64个槽，每槽覆盖下一层一整圈，总跨度2^26个tick，超出的定时器放在最高层，级联时重新放置
+//
+
+#ifndef TNET_EVTIMEWHEEL_H
+#define TNET_EVTIMEWHEEL_H
+
+#include <stdint.h>
+#include <sys/time.h>
+#include "sys/queue.h"
+#include "event2/event_struct.h"
+
+#define TIMER_WHEEL_ROOT_BITS  8
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_ROOT_SIZE  (1 << TIMER_WHEEL_ROOT_BITS)
+#define TIMER_WHEEL_LEVEL_SIZE (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_NLEVELS    3  /* 第0层之外的层数 */
+
+LIST_HEAD(timer_wheel_slot, event);
+
+struct timer_wheel {
+    uint64_t tick_usec;//每个tick的微秒数
+    uint64_t current;//当前tick，该tick之前的槽都已经处理，该tick上的级联已经完成
+    unsigned count;//时间轮中的定时器数目
+
+    struct timer_wheel_slot root[TIMER_WHEEL_ROOT_SIZE];
+    struct timer_wheel_slot levels[TIMER_WHEEL_NLEVELS][TIMER_WHEEL_LEVEL_SIZE];
+
+    //非空槽的位图，删除时不清除（删除时不知道槽位），查找下一个非空槽时延迟清除
+    uint64_t root_bitmap[TIMER_WHEEL_ROOT_SIZE / 64];
+    uint64_t level_bitmap[TIMER_WHEEL_NLEVELS];
+};
+
+//创建时间轮，tick为精度，now为当前时间，失败返回NULL
+struct timer_wheel *timer_wheel_new(const struct timeval *tick, const struct timeval *now);
+void timer_wheel_free(struct timer_wheel *w);
+
+//按ev->ev_timeout把ev放入时间轮 / 从时间轮删除ev，ev必须在时间轮中
+void timer_wheel_add(struct timer_wheel *w, struct event *ev);
+void timer_wheel_del(struct timer_wheel *w, struct event *ev);
+
+static inline int timer_wheel_empty(const struct timer_wheel *w) { return w->count == 0; }
+
+//时间轮中最早需要处理的时刻到now的时间间隔，通过tv返回；时间轮为空返回-1
+int timer_wheel_next_timeout(struct timer_wheel *w, const struct timeval *now, struct timeval *tv);
+
+//返回一个在now之前到期的定时器（调用者负责删除），没有则返回NULL
+struct event *timer_wheel_first_expired(struct timer_wheel *w, const struct timeval *now);
+
+//返回时间轮中任意一个定时器，为空返回NULL，用于释放event_base
+struct event *timer_wheel_first(struct timer_wheel *w);
+
+//ev是否在时间轮中最早到期的槽中
+int timer_wheel_elt_is_first(struct timer_wheel *w, const struct event *ev);
+
+#endif //TNET_EVTIMEWHEEL_H
@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -140,6 +141,16 @@ int evutil_make_tcp_listen_socket_deferred(int sock)
     return 0;
 }
 
+int evutil_make_socket_busy_poll(int sock, int usec)
+{
+#ifdef SO_BUSY_POLL
+    return setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, (socklen_t)sizeof(usec));
+#else
+    errno = ENOPROTOOPT;
+    return -1;
+#endif
+}
+
 int evutil_make_internal_pipe(int fd[2])
 {
     //将第二个套接字设置为非阻塞有点微妙，鉴于我们在写入时忽略任何EAGAIN返回值，并且您不会通过任何方式做一个非阻塞的套接字。 但如果内核给我们EAGAIN，那么不需要再添加任何数据到缓冲区，因为主线程要么已经要唤醒和处理，要么已经唤醒，并在处理过程中
@@ -158,6 +169,11 @@ int evutil_make_internal_pipe(int fd[2])
     return -1;
 }
 
+int evutil_eventfd(unsigned initval)
+{
+    return eventfd(initval, EFD_NONBLOCK | EFD_CLOEXEC);
+}
+
 int evutil_socket(int domain, int type, int protocol)
 {
     int r;
@@ -63,6 +63,8 @@ const char *evutil_getenv(const char *name);
 
 //创建管道
 int evutil_make_internal_pipe(int fd[2]);
+//创建非阻塞、close-on-exec的eventfd，失败返回-1
+int evutil_eventfd(unsigned initval);
 int evutil_socket(int domain, int type, int protocol);
 int evutil_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
 int evutil_socket_connect(int *fd_ptr, struct sockaddr *sa, int socklen);
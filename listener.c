@@ -281,6 +281,7 @@ static void listener_read_cb(int fd, short what, void *p)
     evconnlistener_cb cb;
     evconnlistener_errorcb errorcb;
     void *user_data;
+    int busy_poll;
     LOCK(lev);
     while (1) {
         struct sockaddr_storage ss;
@@ -298,6 +299,9 @@ static void listener_read_cb(int fd, short what, void *p)
             UNLOCK(lev);
             return;
         }
+        if ((busy_poll = event_base_get_busy_poll(lev->ops->getbase(lev))) > 0 &&
+            evutil_make_socket_busy_poll(new_fd, busy_poll) < 0)
+            event_debug(("%s: unable to set SO_BUSY_POLL on fd %d", __func__, new_fd));
         ++lev->refcnt;
         cb = lev->cb;
         user_data = lev->user_data;
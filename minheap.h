@@ -1,20 +1,35 @@
 //
 // 小根堆的实现，主要用于定时器
+// 4叉堆，元素中内联保存超时时间（纳秒），比较时不需要访问event；同一父节点的4个子节点占用一条64字节的cache line
 //
 
 #ifndef TNET_MINHEAP_INTERNAL_H
 #define TNET_MINHEAP_INTERNAL_H
 
+#include <stdint.h>
+#include <string.h>
 #include "event2/event.h"
 #include "event2/event_struct.h"
 #include "event2/util.h"
 #include "evutil.h"
 #include "evmemory.h"
 
+#define MIN_HEAP_ARITY     4
+#define MIN_HEAP_CACHELINE 64
+/* 逻辑下标i存放在物理下标i+MIN_HEAP_PAD处，使得子节点4i+1..4i+4从cache line边界开始 */
+#define MIN_HEAP_PAD       (MIN_HEAP_ARITY - 1)
+
+struct min_heap_elem
+{
+    int64_t key;//超时时间，纳秒
+    struct event *e;
+};
+
 typedef struct min_heap
 {
-    struct event** p;
+    struct min_heap_elem* p;//p[0]为堆顶，按cache line对齐偏移
     unsigned n, a;
+    void *mem;//分配的原始内存
 } min_heap_t;
 
 static inline void	     min_heap_ctor_(min_heap_t* s);
@@ -24,39 +39,83 @@ static inline int	         min_heap_elt_is_top_(const struct event *e);
 static inline int	         min_heap_empty_(min_heap_t* s);
 static inline unsigned	 min_heap_size_(min_heap_t* s);
 static inline struct event*  min_heap_top_(min_heap_t* s);
+static inline int64_t        min_heap_top_key_(min_heap_t* s);
 static inline int	         min_heap_reserve_(min_heap_t* s, unsigned n);
 static inline int	         min_heap_push_(min_heap_t* s, struct event* e);
+static inline int	         min_heap_append_(min_heap_t* s, struct event* e);
+static inline void	     min_heap_heapify_(min_heap_t* s);
 static inline struct event*  min_heap_pop_(min_heap_t* s);
 static inline int	         min_heap_adjust_(min_heap_t *s, struct event* e);
 static inline int	         min_heap_erase_(min_heap_t* s, struct event* e);
-static inline void	     min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct event* e);
-static inline void	     min_heap_shift_up_unconditional_(min_heap_t* s, unsigned hole_index, struct event* e);
-static inline void	     min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct event* e);
+static inline void	     min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x);
+static inline void	     min_heap_shift_up_unconditional_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x);
+static inline void	     min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x);
+
+#define min_heap_parent_(i) (((i) - 1) / MIN_HEAP_ARITY)
+#define min_heap_first_child_(i) (MIN_HEAP_ARITY * (i) + 1)
+
+static inline int64_t min_heap_key_(const struct event *e)
+{
+    return (int64_t)e->ev_timeout.tv_sec * 1000000000 + (int64_t)e->ev_timeout.tv_usec * 1000;
+}
+
+static inline struct min_heap_elem min_heap_make_elem_(struct event *e)
+{
+    struct min_heap_elem x;
+    x.key = min_heap_key_(e);
+    x.e = e;
+    return x;
+}
 
-#define min_heap_elem_greater(a, b) \
-	(evutil_timercmp(&(a)->ev_timeout, &(b)->ev_timeout, >))
+//把x放到hole_index处
+#define min_heap_place_(s, hole_index, x) \
+	((s)->p[hole_index] = (x), (x).e->ev_timeout_pos.min_heap_idx = (hole_index))
 
-void min_heap_ctor_(min_heap_t* s) { s->p = 0; s->n = 0; s->a = 0; }
-void min_heap_dtor_(min_heap_t* s) { if (s->p) mm_free(s->p); }
+void min_heap_ctor_(min_heap_t* s) { s->p = 0; s->n = 0; s->a = 0; s->mem = 0; }
+void min_heap_dtor_(min_heap_t* s) { if (s->mem) mm_free(s->mem); }
 void min_heap_elem_init_(struct event* e) { e->ev_timeout_pos.min_heap_idx = -1; }
 int min_heap_empty_(min_heap_t* s) { return 0u == s->n; }
 unsigned min_heap_size_(min_heap_t* s) { return s->n; }
-struct event* min_heap_top_(min_heap_t* s) { return s->n ? *s->p : 0; }
+struct event* min_heap_top_(min_heap_t* s) { return s->n ? s->p[0].e : 0; }
+int64_t min_heap_top_key_(min_heap_t* s) { return s->p[0].key; }
 
 int min_heap_push_(min_heap_t* s, struct event* e)
 {
     if (min_heap_reserve_(s, s->n + 1))
         return -1;
-    min_heap_shift_up_(s, s->n++, e);
+    min_heap_shift_up_(s, s->n++, min_heap_make_elem_(e));
     return 0;
 }
 
+//追加到末尾，不调整堆，之后必须调用min_heap_heapify_
+int min_heap_append_(min_heap_t* s, struct event* e)
+{
+    struct min_heap_elem x;
+    if (min_heap_reserve_(s, s->n + 1))
+        return -1;
+    x = min_heap_make_elem_(e);
+    min_heap_place_(s, s->n, x);
+    ++s->n;
+    return 0;
+}
+
+//自底向上建堆，O(n)
+void min_heap_heapify_(min_heap_t* s)
+{
+    if (s->n < 2)
+        return;
+    for (unsigned i = min_heap_parent_(s->n - 1) + 1; i-- > 0;)
+        min_heap_shift_down_(s, i, s->p[i]);
+}
+
 struct event* min_heap_pop_(min_heap_t* s)
 {
     if (s->n)
     {
-        struct event* e = *s->p;
-        min_heap_shift_down_(s, 0u, s->p[--s->n]);
+        struct event* e = s->p[0].e;
+        --s->n;
+        if (s->n)
+            min_heap_shift_down_(s, 0u, s->p[s->n]);
         e->ev_timeout_pos.min_heap_idx = -1;
         return e;
     }
@@ -72,17 +131,15 @@ int min_heap_erase_(min_heap_t* s, struct event* e)
 {
     if (-1 != e->ev_timeout_pos.min_heap_idx)
     {
-        struct event *last = s->p[--s->n];
-        unsigned parent = (e->ev_timeout_pos.min_heap_idx - 1) / 2;
-        /* we replace e with the last element in the heap.  We might need to
-           shift it upward if it is less than its parent, or downward if it is
-           greater than one or both its children. Since the children are known
-           to be less than the parent, it can't need to shift both up and
-           down. */
-        if (e->ev_timeout_pos.min_heap_idx > 0 && min_heap_elem_greater(s->p[parent],last))
-            min_heap_shift_up_unconditional_(s, e->ev_timeout_pos.min_heap_idx, last);
-        else
-            min_heap_shift_down_(s, e->ev_timeout_pos.min_heap_idx, last);
+        unsigned idx = e->ev_timeout_pos.min_heap_idx;
+        struct min_heap_elem last = s->p[--s->n];
+        /* 用最后一个元素替换e，它比父节点小时上移，否则下移，不会两者都需要 */
+        if (idx != s->n) {
+            if (idx > 0 && s->p[min_heap_parent_(idx)].key > last.key)
+                min_heap_shift_up_unconditional_(s, idx, last);
+            else
+                min_heap_shift_down_(s, idx, last);
+        }
         e->ev_timeout_pos.min_heap_idx = -1;
         return 0;
     }
@@ -94,13 +151,13 @@ int min_heap_adjust_(min_heap_t *s, struct event *e)
     if (-1 == e->ev_timeout_pos.min_heap_idx) {
         return min_heap_push_(s, e);
     } else {
-        unsigned parent = (e->ev_timeout_pos.min_heap_idx - 1) / 2;
-        /* The position of e has changed; we shift it up or down
-         * as needed.  We can't need to do both. */
-        if (e->ev_timeout_pos.min_heap_idx > 0 && min_heap_elem_greater(s->p[parent], e))
-            min_heap_shift_up_unconditional_(s, e->ev_timeout_pos.min_heap_idx, e);
+        unsigned idx = e->ev_timeout_pos.min_heap_idx;
+        struct min_heap_elem x = min_heap_make_elem_(e);
+        /* e的超时时间改变了，上移或者下移，不会两者都需要 */
+        if (idx > 0 && s->p[min_heap_parent_(idx)].key > x.key)
+            min_heap_shift_up_unconditional_(s, idx, x);
         else
-            min_heap_shift_down_(s, e->ev_timeout_pos.min_heap_idx, e);
+            min_heap_shift_down_(s, idx, x);
         return 0;
     }
 }
@@ -109,54 +166,67 @@ int min_heap_reserve_(min_heap_t* s, unsigned n)
 {
     if (s->a < n)
     {
-        struct event** p;
+        void *mem;
+        struct min_heap_elem *p;
         unsigned a = s->a ? s->a * 2 : 8;
         if (a < n)
             a = n;
-        if (!(p = (struct event**)mm_realloc(s->p, a * sizeof *p)))
+        /* 不能用realloc：新内存的对齐偏移可能不同 */
+        if (!(mem = mm_malloc((a + MIN_HEAP_PAD) * sizeof *p + MIN_HEAP_CACHELINE)))
             return -1;
+        p = (struct min_heap_elem *)(((uintptr_t)mem + MIN_HEAP_CACHELINE - 1) & ~(uintptr_t)(MIN_HEAP_CACHELINE - 1));
+        p += MIN_HEAP_PAD;
+        if (s->n)
+            memcpy(p, s->p, s->n * sizeof *p);
+        if (s->mem)
+            mm_free(s->mem);
+        s->mem = mem;
         s->p = p;
         s->a = a;
     }
     return 0;
 }
 
-void min_heap_shift_up_unconditional_(min_heap_t* s, unsigned hole_index, struct event* e)
+void min_heap_shift_up_unconditional_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x)
 {
-    unsigned parent = (hole_index - 1) / 2;
+    unsigned parent = min_heap_parent_(hole_index);
     do
     {
-        (s->p[hole_index] = s->p[parent])->ev_timeout_pos.min_heap_idx = hole_index;
+        min_heap_place_(s, hole_index, s->p[parent]);
         hole_index = parent;
-        parent = (hole_index - 1) / 2;
-    } while (hole_index && min_heap_elem_greater(s->p[parent], e));
-    (s->p[hole_index] = e)->ev_timeout_pos.min_heap_idx = hole_index;
+        parent = min_heap_parent_(hole_index);
+    } while (hole_index && s->p[parent].key > x.key);
+    min_heap_place_(s, hole_index, x);
 }
 
-void min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct event* e)
+void min_heap_shift_up_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x)
 {
-    unsigned parent = (hole_index - 1) / 2;
-    while (hole_index && min_heap_elem_greater(s->p[parent], e))
+    unsigned parent = min_heap_parent_(hole_index);
+    while (hole_index && s->p[parent].key > x.key)
     {
-        (s->p[hole_index] = s->p[parent])->ev_timeout_pos.min_heap_idx = hole_index;
+        min_heap_place_(s, hole_index, s->p[parent]);
         hole_index = parent;
-        parent = (hole_index - 1) / 2;
+        parent = min_heap_parent_(hole_index);
     }
-    (s->p[hole_index] = e)->ev_timeout_pos.min_heap_idx = hole_index;
+    min_heap_place_(s, hole_index, x);
 }
 
-void min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct event* e)
+void min_heap_shift_down_(min_heap_t* s, unsigned hole_index, struct min_heap_elem x)
 {
-    unsigned min_child = 2 * (hole_index + 1);
-    while (min_child <= s->n)
+    unsigned child = min_heap_first_child_(hole_index);
+    while (child < s->n)
     {
-        min_child -= min_child == s->n || min_heap_elem_greater(s->p[min_child], s->p[min_child - 1]);
-        if (!(min_heap_elem_greater(e, s->p[min_child])))
+        unsigned min_child = child;
+        unsigned end = child + MIN_HEAP_ARITY < s->n ? child + MIN_HEAP_ARITY : s->n;
+        for (unsigned i = child + 1; i < end; ++i)
+            if (s->p[i].key < s->p[min_child].key)
+                min_child = i;
+        if (!(x.key > s->p[min_child].key))
             break;
-        (s->p[hole_index] = s->p[min_child])->ev_timeout_pos.min_heap_idx = hole_index;
+        min_heap_place_(s, hole_index, s->p[min_child]);
         hole_index = min_child;
-        min_child = 2 * (hole_index + 1);
+        child = min_heap_first_child_(hole_index);
     }
-    (s->p[hole_index] = e)->ev_timeout_pos.min_heap_idx = hole_index;
+    min_heap_place_(s, hole_index, x);
 }
 #endif //TNET_MINHEAP_INTERNAL_H